@@ -41,6 +41,18 @@ using DecodeAttributeFunc = void (*)(VertexStreamContext& ctx, s32 vertexCount,
 extern GetStreamInfoFunc sAttributeGetStreamInfoFunctions[0x71];
 extern DecodeAttributeFunc sAttributeDecodeFunctions[0x71];
 
+// the attributes (bit i = attribute i) whose decoded output a decode function of this format reads, without consuming anything from ctx
+// (cross products read their two inputs, triangle texcoords read the positions)
+u32 PeekAttributeReferences(u32 attrFormat, const DecompContext& ctx);
+// consumes whatever a decode function of this format reads from ctx itself on top of its input streams and sets up saved so that the
+// decode function can read the same values from it later on instead (from storage, which has to stay around until then)
+void SaveAttributeInputs(u32 attrFormat, DecompContext& ctx, DecompContext& saved, u64& storage);
+// same but for a decode function that never runs
+void SkipAttributeInputs(u32 attrFormat, DecompContext& ctx);
+// mask + every attribute of the current vertex format that a decode function of one of those could read the output of
+// (which ones actually get read is only known partway through each vertex block, so this goes by the format alone)
+u32 GetAttributeReferenceClosure(const VertexStreamContext& ctx, u32 mask);
+
 void DecodeBackrefs(VertexStreamContext& ctx, s32 vertexCount [[maybe_unused]], VertexDecodeGroup* groups, u32 numGroups);
 
 } // namespace mc
\ No newline at end of file
@@ -12,8 +12,80 @@
 #include <byteswap.h>
 #endif
 
+// the hot loops get extra copies built for newer x86 extensions that are picked at runtime, see HasBMI2/HasAVX2
+// the bit stream loops for bmi2 (shrx/bzhi) + movbe, the entropy decoders for avx2
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define MC_X86_DISPATCH
+#define MC_TARGET_BMI2 __attribute__((target("bmi2,movbe")))
+#define MC_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#endif
+
+#ifdef _MSC_VER
+#define MC_FORCE_INLINE __forceinline
+#else
+#define MC_FORCE_INLINE __attribute__((always_inline)) inline
+#endif
+
 namespace mc {
 
+// off = always the portable paths, for comparing against them (only change it while nothing is being decoded)
+inline bool sCpuDispatchEnabled = true;
+// the avx2 entropy decoders are built around gathers, which don't beat the scalar loops with only 3-4 streams in flight (on a xeon about
+// 270 against 680 Msymbols/s for DecodeFunction0 and 225 against 580 for DecodeFunction1) and are a lot slower still on cpus with
+// microcoded gathers (e.g. with the gather data sampling mitigation), so both are off unless asked for, see mc_test --bench entropy
+inline bool sGatherDecodersEnabled = false;
+
+inline void SetCpuDispatch(bool enabled) {
+    sCpuDispatchEnabled = enabled;
+}
+
+inline void SetGatherDecoders(bool enabled) {
+    sGatherDecodersEnabled = enabled;
+}
+
+inline bool HasBMI2() {
+#ifdef MC_X86_DISPATCH
+    static const bool supported = [] {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_MOVBE) == 0)
+            return false;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+            return false;
+        return (ebx & bit_BMI2) != 0;
+    }();
+    return supported && sCpuDispatchEnabled;
+#else
+    return false;
+#endif
+}
+
+inline bool HasAVX2() {
+#ifdef MC_X86_DISPATCH
+    static const bool supported = [] {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_AVX) == 0 || (ecx & bit_OSXSAVE) == 0 || (ecx & bit_POPCNT) == 0)
+            return false;
+        // the os has to save the ymm registers too
+        unsigned int xcr0, xcr0High;
+        __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+        if ((xcr0 & 6) != 6)
+            return false;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+            return false;
+        return (ebx & bit_AVX2) != 0;
+    }();
+    return supported && sCpuDispatchEnabled;
+#else
+    return false;
+#endif
+}
+
+inline bool UseGatherDecoders() {
+    return sGatherDecodersEnabled && HasAVX2();
+}
+
 inline u64 Swap(u64 value) {
 #ifdef _MSC_VER
     return _byteswap_uint64(value);
@@ -114,7 +186,7 @@ enum class Direction : s32 {
         mDirection = dir;
     }
 
-    void SetStream(u64* stream) {
+    void SetStream(const u64* stream) {
         mStream = stream;
     }
 
@@ -201,6 +273,10 @@ enum class Direction : s32 {
         return mDirection != Direction::Forwards;
     }
 
+    Direction GetDirection() const {
+        return mDirection;
+    }
+
 protected:
     const u64* mStream;
     u64 mRemainder;
@@ -208,4 +284,66 @@ protected:
     Direction mDirection;
 };
 
+// BitStreamReader with the direction fixed at compile time (so no branching on it per read) that can also take several values out of a
+// single refill, same state as BitStreamReader so it can pick up from one and hand back to it at any point
+// for the hot loops, meant to be kept in registers for the duration of the loop
+template <BitStreamReader::Direction Dir>
+class FixedBitStreamReader {
+public:
+    explicit FixedBitStreamReader(const BitStreamReader& reader) : mStream(reader.GetStream()), mRemainder(reader.GetRemainder()), mOffset(reader.GetBitOffset()) {}
+    explicit FixedBitStreamReader(const u64* stream) : mStream(stream), mRemainder(0), mOffset(0) {}
+
+    void Store(BitStreamReader& reader) const {
+        reader.SetStream(mStream);
+        reader.SetRemainder(mRemainder);
+        reader.SetBitOffset(mOffset);
+    }
+
+    // after this up to 56 bits can be taken before the next refill, refilling without taking anything in between doesn't advance the stream
+    void Refill() {
+        mRemainder |= Load() >> (mOffset & 0x3fu);
+        if constexpr (Dir == BitStreamReader::Direction::Forwards)
+            mStream = reinterpret_cast<const u64*>(reinterpret_cast<uintptr_t>(mStream) + (mOffset >> 3 ^ 7));
+        else
+            mStream = reinterpret_cast<const u64*>(reinterpret_cast<uintptr_t>(mStream) - (mOffset >> 3 ^ 7));
+        mOffset |= 0x38u;
+    }
+
+    // unlike BitStreamReader::Read, nbits = 0 gives 0
+    u64 Take(u32 nbits) {
+        const u64 value = mRemainder >> 1 >> (0x3fu - nbits);
+        mRemainder <<= nbits;
+        mOffset -= nbits;
+        return value;
+    }
+
+    u64 Read(u32 nbits) {
+        Refill();
+        return Take(nbits);
+    }
+
+    u64 ReadZeroes() {
+        Refill();
+        const u32 numZeroes = Clz(mRemainder);
+        Take(numZeroes + 1);
+        return numZeroes;
+    }
+
+private:
+    u64 Load() const {
+        // movbe for forward streams when built for it
+        if constexpr (Dir == BitStreamReader::Direction::Forwards)
+            return Swap(*mStream);
+        else
+            return *mStream;
+    }
+
+    const u64* mStream;
+    u64 mRemainder;
+    u32 mOffset;
+};
+
+using ForwardBitStreamReader = FixedBitStreamReader<BitStreamReader::Direction::Forwards>;
+using BackwardBitStreamReader = FixedBitStreamReader<BitStreamReader::Direction::Backwards>;
+
 } // namespace mc
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include "mc_IndexDecompressor.h"
 #include "mc_IndexStreamContext.h"
+#include "mc_DecompContext.h"
 #include "mc_StreamContext.h"
 #include "mc_VertexDecompContext.h"
 #include "mc_VertexDecompressor.h"
@@ -13,6 +14,9 @@
 namespace mc {
 
 class StackAllocator;
+class ThreadPool;
+struct VertexAttributeInfo;
+struct VertexBufferInfo;
 
 class CodecBase {
 public:
@@ -21,6 +25,16 @@ public:
     virtual void Initialize(const StreamContext* indexStream, const StreamContext* vertexStream, u32, StackAllocator* allocator) = 0;
     virtual void Decompress(DecompContext&) = 0;
     virtual void Finalize() = 0;
+    // prepares an already initialized codec for a new stream, keeping any buffers it allocated
+    virtual void Reset(const StreamContext* indexStream, const StreamContext* vertexStream) = 0;
+    // whether the codec still holds pointers into frames it was already given (so they have to stay alive for the next frame)
+    virtual bool HasPendingInputReferences() const {
+        return false;
+    }
+    // which vertex attributes to decode (see DecodeOptions::attributeMask), set after Initialize/Reset, only MeshCodec supports it
+    virtual void SetAttributeMask(u32 mask [[maybe_unused]]) {}
+    // where to run the attribute decode functions (see DecodeOptions::attributeThreads), null = on the calling thread
+    virtual void SetAttributePool(ThreadPool* pool [[maybe_unused]]) {}
 };
 
 class NullCodec : public CodecBase {
@@ -32,6 +46,7 @@ public:
     void Initialize(const StreamContext* indexStream, const StreamContext* vertexStream, u32, StackAllocator* allocator) override;
     void Decompress(DecompContext&) override;
     void Finalize() override;
+    void Reset(const StreamContext* indexStream, const StreamContext* vertexStream) override;
 
 private:
     u8* mVertexOutputBuffer;
@@ -50,6 +65,7 @@ public:
     void Initialize(const StreamContext* indexStream, const StreamContext* vertexStream, u32, StackAllocator* allocator) override;
     void Decompress(DecompContext&) override;
     void Finalize() override;
+    void Reset(const StreamContext* indexStream, const StreamContext* vertexStream) override;
 
 private:
     ZSTD_DCtx* mDCtx = nullptr;
@@ -60,8 +76,20 @@ private:
     StackAllocator* mStackAllocator;
 };
 
+// everything MeshCodec carries over from one mesh to the next, minus the zstd window and the contents of its buffers
+struct MeshCodecCheckpoint {
+    IndexStreamContext indexStreamContext;
+    VertexStreamContext vertexStreamContext;
+    VertexDecompressor::State vertexDecompressor;
+    IndexDecompressor::State indexDecompressor;
+};
+
 class MeshCodec : public CodecBase {
 public:
+    // called at the start of every mesh with the number of blocks left in the frame, returning false stops decoding right before the mesh
+    // (the rest of the frame is left unread)
+    using MeshCallback = bool (*)(void* userData, const DecompContext& ctx, u32 blocksRemaining);
+
     MeshCodec() = default;
 
     ~MeshCodec() override = default;
@@ -69,8 +97,83 @@ public:
     void Initialize(const StreamContext* indexStream, const StreamContext* vertexStream, u32, StackAllocator* allocator) override;
     void Decompress(DecompContext&) override;
     void Finalize() override;
+    void Reset(const StreamContext* indexStream, const StreamContext* vertexStream) override;
+    // stage 5 decodes vertex block groups read in stage 4 which may point straight into the frame they were read from
+    bool HasPendingInputReferences() const override {
+        return mStage == 5;
+    }
+    void SetAttributeMask(u32 mask) override;
+    void SetAttributePool(ThreadPool* pool) override;
+
+    void SetMeshCallback(MeshCallback callback, void* userData) {
+        mMeshCallback = callback;
+        mMeshCallbackUserData = userData;
+    }
+
+    // only valid at the start of a mesh (from inside the mesh callback)
+    void SaveCheckpoint(MeshCodecCheckpoint& checkpoint) const;
+    // puts a freshly initialized/reset codec into the state saved by SaveCheckpoint, the zstd window starts out empty and the
+    // ring buffers cleared, so the result only matches a full decode for meshes that don't reference anything decoded before them
+    void RestoreCheckpoint(const MeshCodecCheckpoint& checkpoint);
+    // the ring buffers + work buffers a checkpoint leaves cleared, restoring them after RestoreCheckpoint also makes meshes that only reference
+    // those (and not the zstd entropy tables or earlier output) decode the same as in a full decode
+    static constexpr size_t cWindowSize = VertexDecompressor::cRingBufferSize + IndexDecompressor::cWorkBufferSize0 + IndexDecompressor::cWorkBufferSize1;
+    void SaveWindow(u8* window) const;
+    void RestoreWindow(const u8* window);
+    // continues decoding partway through a frame (see StackAllocator::ResumeFrame)
+    void Resume(DecompContext& ctx, u32 blocksRemaining);
+
+    u8* GetIndexOutput() const {
+        return mIndexStreamContext.streamContext.stream;
+    }
+    u8* GetVertexOutput() const {
+        return mVertexOutputBuffer;
+    }
+    // the layout of the last mesh's vertex buffers, only valid from inside the mesh callback (before the next mesh is read) or after
+    // the stream, returns how many there are (at most 15)
+    u32 GetVertexBuffers(VertexBufferInfo* buffers) const;
+    // same for the attributes (at most 15)
+    u32 GetVertexAttributes(VertexAttributeInfo* attributes) const;
+    u32 GetVertexCount() const {
+        return mNumVertices;
+    }
+    // same for the size of the last mesh's indices, 0 before any index stream was read
+    u32 GetIndexStride() const {
+        return mIndexStreamContext.indexFormat == IndexFormat::Invalid ? 0 : 4 >> static_cast<u32>(mIndexStreamContext.indexFormat);
+    }
+    // how far the index and vertex buffers have been written, only exact between meshes (from inside the mesh callback)
+    u32 GetIndexOutputOffset() const {
+        return mIndexStreamContext.indexOffset;
+    }
+    u32 GetVertexOutputOffset() const {
+        return mVertexStreamContext.totalVertexOutputSize;
+    }
 
 private:
+    // an attribute of the current vertex block that was read past without being decoded yet, to be decoded on the thread pool at the end of the block
+    struct DeferredAttribute {
+        DecompContext ctx; // for the decode function to read its own inputs from, see SaveAttributeInputs
+        u64 inputs;
+        u8* streams[6];
+        VertexDecodeGroup* groups;
+        void* allocation; // copy of the groups + streams
+        u32 groupCount;
+        s32 streamCount; // 0 = only backrefs
+        u32 attrFormat;
+    };
+
+    void InitializeStreams(const StreamContext* indexStream, const StreamContext* vertexStream);
+    void DecompressBlocks(DecompContext& ctx, u32 numBlocks);
+
+    // stage 5 for a single attribute when not every attribute is wanted or the decode functions run on a thread pool
+    void ProcessAttribute(DecompContext& ctx, s32 vertCount, VertexDecodeGroup* groups, u32 groupCount, s32 count);
+    void DeferAttribute(DecompContext& ctx, VertexDecodeGroup* groups, u32 groupCount, const AttrStreamInfo* streamInfo, s32 streamCount, u32 attrFormat);
+    // only touches the output buffer so it's safe to call for different attributes at the same time
+    void RunDeferredAttribute(u32 attrIndex, s32 vertCount) const;
+    // at the end of a vertex block, decodes every deferred attribute on the thread pool
+    void DecodeDeferredAttributesOnPool(s32 vertCount);
+    void ReleaseDeferredAttributes();
+
     StackAllocator* mStackAllocator;
     u8* mEncodedAttributeStreams[6];
     void* mAttributeStreamAllocations[6];
@@ -92,7 +195,14 @@ private:
     bool mHasIndexBuffer;
     VertexStreamContext mVertexStreamContext;
     u32 mStage;
-    u8 _324[0x420 - 0x324];
+    u32 mAttributeMask;
+    u32 mDecodeMask; // mAttributeMask + whatever those may reference in the current mesh, see GetAttributeReferenceClosure
+    u32 mDeferredAttributeMask; // attributes of the current vertex block that wait for the thread pool
+    DeferredAttribute* mDeferredAttributes; // one per attribute, allocated the first time something gets deferred in a stream
+    ThreadPool* mAttributePool;
+    MeshCallback mMeshCallback;
+    void* mMeshCallbackUserData;
+    u8 _350[0x420 - 0x350];
 };
 
 } // namespace mc
\ No newline at end of file
@@ -13,4 +13,47 @@ struct DecompContext {
     u64 _50;
 };
 
-} // namespace mc
\ No newline at end of file
+// a position inside a frame that decoding can pick back up from (see StackAllocator::ResumeFrame)
+// everything is relative to the start of the frame so it stays valid when the input is loaded somewhere else
+struct FrameCursor {
+    struct BitStreamState {
+        s64 offset;
+        u64 remainder;
+        u32 bitOffset;
+        BitStreamReader::Direction direction;
+
+        void Save(const BitStreamReader& reader, const u8* frame) {
+            offset = reinterpret_cast<const u8*>(reader.GetStream()) - frame;
+            remainder = reader.GetRemainder();
+            bitOffset = reader.GetBitOffset();
+            direction = reader.GetDirection();
+        }
+
+        void Restore(BitStreamReader& reader, const u8* frame) const {
+            reader = BitStreamReader(reinterpret_cast<const u64*>(frame + offset), direction);
+            reader.SetRemainder(remainder);
+            reader.SetBitOffset(bitOffset);
+        }
+    };
+
+    BitStreamState bitStreams[3];
+    s64 currentPos;
+    u32 blocksRemaining; // codec blocks left in the frame
+
+    void Save(const DecompContext& ctx, const u8* frame, u32 blocks) {
+        bitStreams[0].Save(ctx.bitStream0, frame);
+        bitStreams[1].Save(ctx.bitStream1, frame);
+        bitStreams[2].Save(ctx.bitStream2, frame);
+        currentPos = ctx.currentPos - frame;
+        blocksRemaining = blocks;
+    }
+
+    void Restore(DecompContext& ctx, const u8* frame) const {
+        bitStreams[0].Restore(ctx.bitStream0, frame);
+        bitStreams[1].Restore(ctx.bitStream1, frame);
+        bitStreams[2].Restore(ctx.bitStream2, frame);
+        ctx.currentPos = frame + currentPos;
+    }
+};
+
+} // namespace mc
@@ -19,10 +19,15 @@ struct WorkBuffer {
 
 class IndexDecompressor {
 public:
+    static constexpr u32 cWorkBufferSize0 = 0x60010;
+    static constexpr u32 cWorkBufferSize1 = 0x20010;
+
     IndexDecompressor() = default;
 
     void Initialize(u32, ZSTD_DCtx*, StackAllocator*);
     void Finalize();
+    // rewinds the work buffers for a new stream without reallocating them
+    void Reset();
 
     void SetContext(DecompContext* ctx) {
         mDecompContext = ctx;
@@ -36,6 +41,24 @@ public:
         mBaseIndex = idx;
     }
 
+    // what carries over from one mesh to the next, minus the work buffer contents
+    struct State {
+        WorkBuffer workBuffers[2]; // addr unused
+        u32 inputOffsets[2]; // from the start of each work buffer
+        s32 trianglesRemaining;
+        u32 _54;
+        u32 numVertices;
+        u32 baseIndex;
+    };
+
+    void SaveState(State& state) const;
+    // the work buffers get cleared so that decoding from here on doesn't depend on whatever was in them
+    void RestoreState(const State& state);
+
+    // the work buffers are also the zstd window for the index streams (cWorkBufferSize0 + cWorkBufferSize1 bytes)
+    void SaveWorkBuffers(u8* dst) const;
+    void RestoreWorkBuffers(const u8* src);
+
     u32 Decompress1(void* dst, IndexFormat indexFormat, u32 count, u32 baseIndex, u64* decodeBuf, u32 numCopied, u32 remaining);
     u32 Decompress2(void* dst, IndexFormat indexFormat, u32 count, u32 baseIndex, u64* decodeBuf, u32 numCopied, u32 remaining);
     u32 Decompress3(void* dst, IndexFormat indexFormat, u32 count, u32 baseIndex, u64* decodeBuf, u32 numCopied, u32 remaining);
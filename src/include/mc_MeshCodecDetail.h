@@ -0,0 +1,133 @@
+#pragma once
+
+#include "mc_MeshCodec.h"
+
+#include "mc_Zstd.h"
+
+#include <algorithm> // std::max
+#include <memory>
+
+namespace mc {
+
+class ThreadPool;
+
+// nn::util::BinaryFileHeader
+struct BinaryFileHeader {
+    u64 magic;
+    u8 verMicro;
+    u8 verMinor;
+    u16 verMajor;
+    u16 bom;
+    u8 align;
+    u32 filenameOffset;
+    u16 isRelocated;
+    u16 firstBlockOffset;
+    u32 relocationTableOffset;
+    u32 fileSize;
+};
+
+namespace detail {
+
+// shared between the one-shot functions in mc_MeshCodec.cpp and DecoderSession
+
+// lazy hack
+inline bool HasFMSHSection(const void* ptr) {
+    return (*(reinterpret_cast<const u8*>(ptr) + 0xee) >> 3) & 1;
+}
+
+inline bool IsValidPackageHeader(const void* src, size_t srcSize) {
+    if (srcSize < sizeof(ResMeshCodecPackageHeader) || src == nullptr)
+        return false;
+
+    auto header = reinterpret_cast<const ResMeshCodecPackageHeader*>(src);
+
+    if (header->magic != ResMeshCodecPackageHeader::cMagic)
+        return false;
+
+    return header->versionMajor == 0 && header->versionMinor <= 1;
+}
+
+// bufferless decompression state for the (magicless) zstd frame holding the bfres file
+struct PackageFrame {
+    const u8* input;
+    size_t remainingInput;
+    size_t nextInputSize;   // 0 once the frame is done
+    u8* output;
+    size_t outputOffset;
+    size_t outputCapacity;
+};
+
+// the dctx must already be set up for ZSTD_f_zstd1_magicless
+void BeginPackageFrame(ZSTD_DCtx* dctx, PackageFrame& frame, void* dst, size_t dstSize, const void* src, size_t srcSize);
+
+// decompresses blocks until at least minOutputSize bytes have been written or the frame ends, returns false on error
+bool ContinuePackageFrame(ZSTD_DCtx* dctx, PackageFrame& frame, size_t minOutputSize = static_cast<size_t>(-1));
+
+// decompresses the whole frame, the dctx must already be set up for ZSTD_f_zstd1_magicless
+// returns a pointer to the end of the frame or nullptr on failure, remaining is set to the number of bytes left after it and outputSize to the size of the bfres file
+const u8* DecompressPackage(ZSTD_DCtx* dctx, void* dst, size_t dstSize, const void* src, size_t srcSize, size_t& remaining, size_t& outputSize);
+
+// called with where the FMSH buffers go, the FMSH header and the size of the FMSH section, returns 0 on success (same as DecompressFMSH)
+using FMSHDecodeFunc = u32 (*)(void* userData, u8* output, const ResMeshCodecHeader* header, size_t compressedSize);
+
+// decompresses a whole .bfres.mc file (header already validated) with the FMSH section being decoded on a second thread
+// while the rest of the zstd frame is decompressed on this one
+// the frame end is found upfront by walking the block headers and the FMSH output region only depends on the bfres file size,
+// which is known as soon as the first block is done
+// falls back to doing both one after the other on this thread if the file is too small for that to be worth it
+// outputSize is set to the size of the bfres file
+bool DecompressPackageConcurrent(ZSTD_DCtx* dctx, void* dst, size_t dstSize, const void* src, size_t srcSize, FMSHDecodeFunc decodeFMSH, void* userData, size_t& outputSize);
+
+// walks the block headers of the (magicless) zstd frame holding the bfres file without decompressing anything
+// returns a pointer to the end of the frame or nullptr if the frame is malformed, contentSize is set to the frame content size if it's recorded or 0 otherwise
+const u8* FindPackageFrameEnd(const void* src, size_t srcSize, size_t& contentSize);
+
+// zeroes everything past the bfres file, writes the size header and returns where the FMSH index + vertex buffers go
+u8* PrepareFMSHOutput(void* dst, size_t dstSize, const ResMeshCodecHeader* fmshHeader, size_t decompressedSize);
+
+inline void SetupFMSHStreams(StreamContext& indexContext, StreamContext& vertexContext, void* dst, const ResMeshCodecHeader* header) {
+    indexContext = {
+        .stream = reinterpret_cast<u8*>(dst),
+        .size = header->indexOutputSize,
+        .alignment = header->indexAlign,
+    };
+    vertexContext = {
+        .stream = reinterpret_cast<u8*>((reinterpret_cast<uintptr_t>(dst) + header->vertexAlign + indexContext.size - 1) & -header->vertexAlign),
+        .size = header->vertexOutputSize,
+        .alignment = header->vertexAlign,
+    };
+}
+
+inline void SetupChunkStreams(StreamContext& indexContext, StreamContext& vertexContext, void* dst, const ResChunkHeader* header) {
+    indexContext = {
+        .stream = reinterpret_cast<u8*>(dst) + header->vertexOutputSize,
+        .size = header->indexOutputSize,
+        .alignment = 2,
+    };
+    vertexContext = {
+        .stream = reinterpret_cast<u8*>(dst),
+        .size = header->vertexOutputSize,
+        .alignment = 4,
+    };
+}
+
+// runs every frame of a stream through an allocator set up by CreateStackAllocator/ResetStackAllocator
+// frameSize is the value returned by that call, headerSize is the size of everything before the first frame
+// returns 0 on success, 0x1c if the stream doesn't end at srcSize, or the converted error otherwise
+// stops early once options.maxMeshes/maxOutputSize is reached (MeshCodec streams only) without reading the rest of the frames
+// if result isn't null, the frame count and the allocator's peak usage are added to it, and if a limit was reached, the sizes in it
+// (which should already hold the full sizes) are cut down to what was actually written
+u32 DecompressFrames(StackAllocator* allocator, s32 frameSize, const void* src, size_t srcSize, u32 headerSize, const DecodeOptions& options, DecodeResult* result = nullptr);
+
+// adds the allocator's peak usage since it was created/reset to result
+inline void RecordPeakUsage(const StackAllocator* allocator, DecodeResult* result) {
+    result->peakWorkMemoryUsage = std::max(result->peakWorkMemoryUsage, sizeof(StackAllocator) + allocator->GetPeakMemoryUsage());
+    result->peakSpilledSize = std::max(result->peakSpilledSize, allocator->GetPeakSpilledSize());
+}
+
+// the threads for DecodeOptions::attributeThreads, null if the attributes get decoded on the calling thread
+std::unique_ptr<ThreadPool> CreateAttributePool(const DecodeOptions& options);
+
+} // namespace detail
+
+} // namespace mc
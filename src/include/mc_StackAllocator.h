@@ -3,17 +3,22 @@
 #include "mc_Types.h"
 #include "mc_CompressionFormat.h"
 #include "mc_StreamContext.h"
+#include "mc_DecodeOptions.h"
 
 #include <memory>
 
 namespace mc {
 
+class ThreadPool;
+
 class CodecBase;
+struct FrameCursor;
 
 enum Result {
     SizeMismatch = 0x80000002,
     InvalidCodec = 0x80000007,
     Error8 = 0x80000008,
+    OutOfMemory = 0x80000009, // the stream needed more work memory than it was given (only with OverflowPolicy::Fail)
     Error20 = 0x80000020,
 };
 
@@ -50,18 +55,36 @@ public:
         StreamContext* vertexStream;
         void* workMemory;
         size_t workMemorySize;
+        OverflowPolicy overflowPolicy = OverflowPolicy::Exit;
+        u32 attributeMask = DecodeOptions::cAllAttributes;
+        ThreadPool* attributePool = nullptr;
     };
 
     StackAllocator(void* mem, size_t memSize, u64 type) : 
         mMemory(reinterpret_cast<u8*>(mem)), mMemorySize(memSize), mMemoryOffset(0),
         mLastAllocationStart(0), mPeakMemoryUsage(0), mAllocatorType(type) {}
 
+    // everything allocated after the codec was set up
+    struct Marker {
+        size_t memoryOffset;
+        size_t lastAllocationStart;
+        size_t spilledSize;
+    };
+
     ~StackAllocator() = default;
 
     void* Alloc(size_t size, s64 alignment);
     void Free(void* ptr);
+    // always from the heap, for codec state that shouldn't take up the work memory the stream asked for
+    // freed with Free like anything else or along with the spilled allocations, doesn't count as spilled
+    void* AllocHeap(size_t size, s64 alignment) {
+        return Spill(size, alignment, false);
+    }
 
     s32 DecompressFrame(const u8* data, size_t size);
+    // continues a MeshCodec stream from a position inside the frame at data that was saved in an earlier decode of the same stream,
+    // the codec must already be in the matching state (see MeshCodec::RestoreCheckpoint), returns the same as DecompressFrame
+    s32 ResumeFrame(const u8* data, const FrameCursor& cursor);
 
     template <typename T, typename... Args>
     T* Create(Args&&... args) {
@@ -72,6 +95,27 @@ public:
         return mPeakMemoryUsage;
     }
 
+    void SetOverflowPolicy(OverflowPolicy policy) {
+        mOverflowPolicy = policy;
+    }
+
+    OverflowPolicy GetOverflowPolicy() const {
+        return mOverflowPolicy;
+    }
+
+    // heap memory currently/at most in use by allocations that didn't fit in the work memory
+    // (the work memory a stream would've needed to not spill is at most GetPeakMemoryUsage() + GetPeakSpilledSize())
+    size_t GetSpilledSize() const {
+        return mSpilledSize;
+    }
+
+    size_t GetPeakSpilledSize() const {
+        return mPeakSpilledSize;
+    }
+
+    // frees every allocation that spilled onto the heap, anything still pointing into them (including the codec) is invalid afterwards
+    void ReleaseOverflow();
+
     void SetFPUState(u32 state) {
         mPreviousFPUState = state;
     }
@@ -93,7 +137,54 @@ public:
         mFrameEndOffset = end;
     }
 
+    void SetCodecType(CodecType type) {
+        mCodecType = type;
+    }
+
+    CodecType GetCodecType() const {
+        return mCodecType;
+    }
+
+    Marker GetMarker() const {
+        return { mMemoryOffset, mLastAllocationStart, mSpilledSize };
+    }
+
+    void SetBaseMarker(const Marker& marker) {
+        mBaseMarker = marker;
+    }
+
+    const Marker& GetBaseMarker() const {
+        return mBaseMarker;
+    }
+
+    // drops every allocation made after the marker was taken (used to reuse an allocator across streams)
+    // spilled allocations can't be told apart by age so they all go, markers taken after something spilled can't be rewound to
+    void Rewind(const Marker& marker) {
+        ReleaseOverflow();
+        mMemoryOffset = marker.memoryOffset;
+        mLastAllocationStart = marker.lastAllocationStart;
+        mPeakMemoryUsage = marker.memoryOffset;
+        mPeakSpilledSize = 0;
+        mOutOfMemory = false;
+    }
+
 private:
+    struct SpillBlock {
+        SpillBlock* prev;
+        SpillBlock* next;
+        size_t size;    // counted in mSpilledSize, 0 for AllocHeap blocks
+    };
+
+    void* Spill(size_t size, s64 alignment, bool overflow);
+    // whatever's left to do once the codec is done with a frame
+    s32 FinishFrame();
+    void FreeSpilled(void* ptr);
+
+    bool IsSpilled(const void* ptr) const {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        return address < reinterpret_cast<uintptr_t>(mMemory) || address >= reinterpret_cast<uintptr_t>(mMemory) + mMemorySize;
+    }
+
     u8* mMemory;
     size_t mMemorySize;
     size_t mMemoryOffset;           // offset to the top of the last allocation in the stack
@@ -104,8 +195,15 @@ private:
     u32 mStreamOffset;
     u32 mFrameEndOffset;
     u32 mPreviousFPUState;
-    [[maybe_unused]] u8 _44[0x80 - 0x44];
+    CodecType mCodecType;
+    Marker mBaseMarker;
+    OverflowPolicy mOverflowPolicy = OverflowPolicy::Exit;
+    bool mOutOfMemory = false;      // set once something spilled with OverflowPolicy::Fail
+    SpillBlock* mSpillList = nullptr;
+    size_t mSpilledSize = 0;
+    size_t mPeakSpilledSize = 0;
 };
+static_assert(sizeof(StackAllocator) == 0x80);
 
 struct CompressionFlags {
     CodecType codec;
@@ -116,6 +214,10 @@ s32 InitializeStackAllocator(StackAllocator**, const CompressionFlags&, const St
 
 s32 CreateStackAllocator(StackAllocator**, const StackAllocator::InitArg&, const ResCompressionHeader*, u64);
 
+// reuses an allocator previously set up by CreateStackAllocator for a new stream without recreating the codec or its buffers
+// returns InvalidCodec if the stream uses a different codec than the one the allocator was created with
+s32 ResetStackAllocator(StackAllocator*, const StackAllocator::InitArg&, const ResCompressionHeader*);
+
 u32 ConvertResult(u64);
 
 } // namespace mc
\ No newline at end of file
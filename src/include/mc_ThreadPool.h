@@ -0,0 +1,58 @@
+#pragma once
+
+#include "mc_Types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mc {
+
+// each worker has its own queue and takes from it first, workers that run out steal from the others
+// tasks are taken from the front of every queue so submission order is kept as much as possible
+class ThreadPool {
+public:
+    using Task = std::function<void(u32 workerIndex)>;
+
+    // 0 uses one worker per hardware thread
+    explicit ThreadPool(u32 threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    u32 GetThreadCount() const {
+        return static_cast<u32>(mWorkers.size());
+    }
+
+    // queues onto the workers round robin
+    void Submit(Task task);
+    // blocks until every submitted task has finished
+    void Wait();
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerMain(u32 workerIndex);
+    bool TryPop(u32 workerIndex, Task& task);
+
+    std::vector<std::thread> mWorkers;
+    std::unique_ptr<WorkerQueue[]> mQueues;
+    std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mWorkFinished;
+    size_t mQueuedTasks = 0;    // guarded by mMutex
+    size_t mPendingTasks = 0;   // queued + running, guarded by mMutex
+    std::atomic<u32> mNextQueue = 0;
+    bool mStop = false;
+};
+
+} // namespace mc
@@ -66,6 +66,115 @@ struct BufferView {
 
 void GenDecodingTable(DecodingContext* decodeCtx, DecompContext& decompCtx);
 
+// GenDecodingTable keeps the last few _00/_01 tables it built on each thread and when the descriptor bits coming up in the stream are the
+// same as one of theirs, copies that table in and skips over the bits instead of building it again
+// off = always build them (only change it while nothing is being decoded)
+inline bool sDecodingTableCacheEnabled = true;
+
+inline void SetDecodingTableCache(bool enabled) {
+    sDecodingTableCacheEnabled = enabled;
+}
+
+struct DecodingTableCacheStats {
+    u64 hits;
+    u64 misses; // tables that had to be built (including ones too large to cache) while the cache was on
+};
+
+// totals over every thread since the last reset
+DecodingTableCacheStats GetDecodingTableCacheStats();
+void ResetDecodingTableCacheStats();
+
+// ByteStreamEncoding::_01 tables give a single symbol per lookup even when the codes are short enough for several of them to fit in the
+// index bits, when every code is at most a third of them the multi symbol table has cMaxTableSymbols symbols per entry instead
+// entries are the symbols (16 bits each) and then the bits they take together
+static constexpr u32 cMaxTableSymbols = 3;
+static constexpr u32 cMaxMultiSymbolBitSize = 11;
+
+// off = always one symbol per lookup, for comparing against it (only change it while nothing is being decoded)
+inline bool sMultiSymbolTablesEnabled = true;
+
+inline void SetMultiSymbolTables(bool enabled) {
+    sMultiSymbolTablesEnabled = enabled;
+}
+
+// with every entry having all 3 symbols each stream takes exactly 2 lookups per group, tables where only some of them do were at best as fast
+// as one symbol per lookup since the number of lookups per group keeps changing (and a lot slower once the codes get longer)
+// building the table is about as much work as a few lookups per entry so the stream should have a lot more symbols than entries
+inline bool UseMultiSymbolTable(const u32* tbl, u32 count, u32 bitSize) {
+    if (!sMultiSymbolTablesEnabled || bitSize < cMaxTableSymbols || bitSize > cMaxMultiSymbolBitSize || count < (0x10u << bitSize))
+        return false;
+
+    u32 maxLength = 0;
+    for (u32 i = 0; i < 1u << bitSize; ++i)
+        maxLength = (tbl[i] >> 0x10) > maxLength ? tbl[i] >> 0x10 : maxLength;
+    return maxLength * cMaxTableSymbols <= bitSize;
+}
+
+// only valid for tables UseMultiSymbolTable accepts
+void BuildMultiSymbolTable(u64* dst, const u32* tbl, u32 bitSize);
+
+#ifdef MC_X86_DISPATCH
+// the main loop of DecodeFunction0 with the 4 states in the 4 lanes of a register, the table lookups are gathers and the refills are a
+// masked load of as many words as there are lanes that need one, spread out to them in lane order, so it's exactly the scalar loop
+// the 4 states depend on their previous lookups so the gather latency never gets hidden, which makes this slower than the scalar loop on
+// the cpus it was measured on, it only runs after SetGatherDecoders(true)
+// returns where the output is at afterwards
+template <typename T>
+MC_TARGET_AVX2 static T* DecodeFunction0AVX2(u64 (&states)[4], T* outPtr, u32 elementSize, u32 groupCount, const u32*& inStream32, const u16* tbl, u32 bitSize) {
+    // which loaded word each lane gets for every combination of lanes that need a refill (the high halves are masked off anyway)
+    alignas(32) static constexpr u32 cRefillPermutes[16][8] = {
+        { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 1, 0, 0, 0, 0, 0 },
+        { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 1, 0, 0, 0 }, { 0, 0, 0, 0, 1, 0, 0, 0 }, { 0, 0, 1, 0, 2, 0, 0, 0 },
+        { 0, 0, 0, 0, 0, 0, 0, 0 }, { 0, 0, 0, 0, 0, 0, 1, 0 }, { 0, 0, 0, 0, 0, 0, 1, 0 }, { 0, 0, 1, 0, 0, 0, 2, 0 },
+        { 0, 0, 0, 0, 0, 0, 1, 0 }, { 0, 0, 0, 0, 1, 0, 2, 0 }, { 0, 0, 0, 0, 1, 0, 2, 0 }, { 0, 0, 1, 0, 2, 0, 3, 0 },
+    };
+
+    const __m256i indexMask = _mm256_set1_epi64x(~(-1 << (bitSize & 0x1f)));
+    const __m256i lowMask = _mm256_set1_epi64x(0xffffffff);
+    const __m128i shift = _mm_cvtsi32_si128(bitSize & 0x3f);
+    // the symbols are read as the upper half of a 32 bit gather starting one entry early, so nothing past the table gets read
+    const int* symbols = reinterpret_cast<const int*>(tbl + 0x1000 - 1);
+    const int* values = reinterpret_cast<const int*>(tbl);
+
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(states));
+    for (u32 i = groupCount; i != 0; --i) {
+        const __m256i index = _mm256_and_si256(v, indexMask);
+        const __m256i value = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32(values, index, 4));
+        const __m128i symbol = _mm_srli_epi32(_mm256_i64gather_epi32(symbols, index, 2), 0x10);
+
+        alignas(16) u32 out[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(out), symbol);
+        outPtr[0] = static_cast<T>(out[0]);
+        outPtr[elementSize] = static_cast<T>(out[1]);
+        outPtr[elementSize * 2] = static_cast<T>(out[2]);
+        outPtr[elementSize * 3] = static_cast<T>(out[3]);
+
+        // (v >> bitSize) * (value >> 16) + (value & 0xffff), the multiply is split into 32 bit halves
+        const __m256i state = _mm256_srl_epi64(v, shift);
+        const __m256i frequency = _mm256_srli_epi64(value, 0x10);
+        const __m256i productLow = _mm256_mul_epu32(state, frequency);
+        const __m256i productHigh = _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(state, 0x20), frequency), 0x20);
+        v = _mm256_add_epi64(_mm256_add_epi64(productLow, productHigh), _mm256_and_si256(value, _mm256_set1_epi64x(0xffff)));
+
+        const __m256i refill = _mm256_cmpeq_epi64(_mm256_srli_epi64(v, 0x1f), _mm256_setzero_si256());
+        const u32 refillMask = static_cast<u32>(_mm256_movemask_pd(_mm256_castsi256_pd(refill)));
+        if (refillMask != 0) {
+            const u32 refillCount = Popcount(refillMask);
+            const __m128i loadMask = _mm_cmpgt_epi32(_mm_set1_epi32(refillCount), _mm_setr_epi32(0, 1, 2, 3));
+            const __m128i words = _mm_maskload_epi32(reinterpret_cast<const int*>(inStream32), loadMask);
+            const __m256i permute = _mm256_load_si256(reinterpret_cast<const __m256i*>(cRefillPermutes[refillMask]));
+            const __m256i spread = _mm256_and_si256(_mm256_permutevar8x32_epi32(_mm256_castsi128_si256(words), permute), lowMask);
+            v = _mm256_blendv_epi8(v, _mm256_or_si256(_mm256_slli_epi64(v, 0x20), spread), refill);
+            inStream32 += refillCount;
+        }
+
+        outPtr += elementSize << 2;
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(states), v);
+    return outPtr;
+}
+#endif
+
 template <typename T>
 static void DecodeFunction0(Encoding1Struct& ctx, DecodeInfo<T>& info, BufferView& buffer, const u16* tbl, u32 bitSize) {
     if constexpr (!std::is_same_v<T, u8> && !std::is_same_v<T, u16>)
@@ -105,6 +214,11 @@ static void DecodeFunction0(Encoding1Struct& ctx, DecodeInfo<T>& info, BufferVie
     u32 stride = info.elementSize << 2;
     T* outPtr = info.output;
     const u32* src = reinterpret_cast<const u32*>(tbl);
+#ifdef MC_X86_DISPATCH
+    if (info.count > 3 && UseGatherDecoders()) {
+        outPtr = DecodeFunction0AVX2(ctx.indexMasks, outPtr, info.elementSize, info.count >> 2, inStream32, tbl, bitSize);
+    } else
+#endif
     if (info.count > 3) {
         u64 v0 = ctx.indexMasks[0];
         u64 v1 = ctx.indexMasks[1];
@@ -165,6 +279,111 @@ static void DecodeFunction0(Encoding1Struct& ctx, DecodeInfo<T>& info, BufferVie
     buffer.offset = static_cast<u32>(reinterpret_cast<uintptr_t>(inStream32) - reinterpret_cast<uintptr_t>(buffer.ptr));
 }
 
+#ifdef MC_X86_DISPATCH
+// the main loop of DecodeFunction1 with the remainders of the three streams in lanes 0-2 of a register, each of the 4 rounds is a gather
+// of the 3 table entries and a variable shift per lane for the bits they used, the refills are the same reads as the scalar loop
+// each gather waits on the shifts of the one before, so like DecodeFunction0AVX2 it's slower than the scalar loop on the cpus it was
+// measured on and only runs after SetGatherDecoders(true) (the multi symbol tables still go first)
+// returns where the output is at afterwards
+template <typename T>
+MC_TARGET_AVX2 static T* DecodeFunction1AVX2(T* out, u32 size, u32 groupCount, DecompContext& ctx, const u32* src, u32 bitSize) {
+    const u32 offset0 = size * 2;
+    const u32 offset1 = size * 3;
+    const __m128i shift = _mm_cvtsi32_si128((0x40u - bitSize) & 0x3f);
+    const __m256i indexMask = _mm256_set1_epi64x(0xffffffff);
+    const __m256i shiftMask = _mm256_set1_epi64x(0x3f);
+
+    __m256i remainders = _mm256_setr_epi64x(ctx.bitStream0.GetRemainder(), ctx.bitStream1.GetRemainder(), ctx.bitStream2.GetRemainder(), 0);
+    for (u32 i = groupCount; i != 0; --i) {
+        __m256i values = _mm256_or_si256(remainders, _mm256_setr_epi64x(ctx.bitStream0.ReadRaw(), ctx.bitStream1.ReadRawForwards(), ctx.bitStream2.ReadRaw(), 0));
+        __m128i consumed = _mm_setzero_si128();
+        for (u32 round = 0; round < 4; ++round) {
+            // lane 3 always looks up entry 0
+            const __m256i index = _mm256_and_si256(_mm256_srl_epi64(values, shift), indexMask);
+            const __m128i entries = _mm256_i64gather_epi32(reinterpret_cast<const int*>(src), index, 4);
+
+            alignas(16) u32 symbols[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(symbols), entries);
+            out[0] = static_cast<T>(symbols[0]);
+            out[size] = static_cast<T>(symbols[1]);
+            out[offset0] = static_cast<T>(symbols[2]);
+
+            const __m128i bits = _mm_srli_epi32(entries, 0x10);
+            values = _mm256_sllv_epi64(values, _mm256_and_si256(_mm256_cvtepu32_epi64(bits), shiftMask));
+            consumed = _mm_add_epi32(consumed, bits);
+            out += offset1;
+        }
+        remainders = values;
+
+        alignas(16) u32 used[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(used), consumed);
+        ctx.bitStream0.SetBitOffset((ctx.bitStream0.GetBitOffset() | 0x38) - used[0]);
+        ctx.bitStream1.SetBitOffset((ctx.bitStream1.GetBitOffset() | 0x38) - used[1]);
+        ctx.bitStream2.SetBitOffset((ctx.bitStream2.GetBitOffset() | 0x38) - used[2]);
+    }
+
+    alignas(32) u64 values[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(values), remainders);
+    ctx.bitStream0.SetRemainder(values[0]);
+    ctx.bitStream1.SetRemainder(values[1]);
+    ctx.bitStream2.SetRemainder(values[2]);
+    return out;
+}
+#endif
+
+// the 4 symbols of one stream in a group of DecodeFunction1, 3 from the multi symbol table and 1 from the regular one
+// returns how many bits they took
+template <typename T>
+MC_FORCE_INLINE u32 DecodeMultiSymbols(T* out, u32 stride, u64& value, const u64* table, const u32* src, u32 shift) {
+    const u64 entry = table[value >> shift & 0xffffffff];
+    out[0] = static_cast<T>(entry);
+    out[stride] = static_cast<T>(entry >> 0x10);
+    out[stride * 2] = static_cast<T>(entry >> 0x20);
+    const u32 bits = static_cast<u32>(entry >> 0x30);
+    value <<= bits;
+
+    const u32 last = src[value >> shift & 0xffffffff];
+    out[stride * 3] = static_cast<T>(last);
+    value <<= last >> 0x10;
+    return bits + (last >> 0x10);
+}
+
+// the main loop of DecodeFunction1 with a multi symbol table, the 4 symbols each stream decodes per refill take 2 lookups instead of 4
+// the bits used and the refills are the same as in the scalar loop
+// returns where the output is at afterwards
+template <typename T>
+static T* DecodeFunction1Multi(T* out, u32 size, u32 groupCount, DecompContext& ctx, const u32* src, u32 bitSize) {
+    u64 table[1 << cMaxMultiSymbolBitSize];
+    BuildMultiSymbolTable(table, src, bitSize);
+
+    const u32 shift = (0x40u - bitSize) & 0x3f;
+    const u32 offset1 = size * 3;
+    u64 remainders[3] = { ctx.bitStream0.GetRemainder(), ctx.bitStream1.GetRemainder(), ctx.bitStream2.GetRemainder() };
+
+    for (u32 i = groupCount; i != 0; --i) {
+        u64 value0 = remainders[0] | ctx.bitStream0.ReadRaw();
+        u64 value1 = remainders[1] | ctx.bitStream1.ReadRawForwards();
+        u64 value2 = remainders[2] | ctx.bitStream2.ReadRaw();
+
+        const u32 used0 = DecodeMultiSymbols(out, offset1, value0, table, src, shift);
+        const u32 used1 = DecodeMultiSymbols(out + size, offset1, value1, table, src, shift);
+        const u32 used2 = DecodeMultiSymbols(out + size * 2, offset1, value2, table, src, shift);
+
+        ctx.bitStream0.SetBitOffset((ctx.bitStream0.GetBitOffset() | 0x38) - used0);
+        ctx.bitStream1.SetBitOffset((ctx.bitStream1.GetBitOffset() | 0x38) - used1);
+        ctx.bitStream2.SetBitOffset((ctx.bitStream2.GetBitOffset() | 0x38) - used2);
+        remainders[0] = value0;
+        remainders[1] = value1;
+        remainders[2] = value2;
+        out += offset1 * 4;
+    }
+
+    ctx.bitStream0.SetRemainder(remainders[0]);
+    ctx.bitStream1.SetRemainder(remainders[1]);
+    ctx.bitStream2.SetRemainder(remainders[2]);
+    return out;
+}
+
 template <typename T>
 static void DecodeFunction1(T* dst, u32 size, u32 count, DecompContext& ctx, const u32* src, u32 bitSize) {
     if constexpr (!std::is_same_v<T, u8> && !std::is_same_v<T, u16>)
@@ -188,6 +407,22 @@ static void DecodeFunction1(T* dst, u32 size, u32 count, DecompContext& ctx, con
     };
 
     T* out = dst;
+    if (count > 0xb && UseMultiSymbolTable(src, count, bitSize)) {
+        out = DecodeFunction1Multi(out, size, count / 0xc, ctx, src, bitSize);
+        bitOffsets = { ctx.bitStream0.GetBitOffset(), ctx.bitStream1.GetBitOffset(), ctx.bitStream2.GetBitOffset() };
+        remainders = { ctx.bitStream0.GetRemainder(), ctx.bitStream1.GetRemainder(), ctx.bitStream2.GetRemainder() };
+        outBufs.outBuf1 = out + size;
+        outBufs.outBuf2 = out + offset0;
+    } else
+#ifdef MC_X86_DISPATCH
+    if (count > 0xb && UseGatherDecoders()) {
+        out = DecodeFunction1AVX2(out, size, count / 0xc, ctx, src, bitSize);
+        bitOffsets = { ctx.bitStream0.GetBitOffset(), ctx.bitStream1.GetBitOffset(), ctx.bitStream2.GetBitOffset() };
+        remainders = { ctx.bitStream0.GetRemainder(), ctx.bitStream1.GetRemainder(), ctx.bitStream2.GetRemainder() };
+        outBufs.outBuf1 = out + size;
+        outBufs.outBuf2 = out + offset0;
+    } else
+#endif
     if (count > 0xb) {
         u64 offset2 = offset1 * 2;
         u64 offset3 = offset1 * 3;
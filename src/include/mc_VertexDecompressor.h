@@ -1,23 +1,42 @@
 #pragma once
 
 #include "mc_AttributeCodec.h"
+#include "mc_VertexCodec.h"
 
 #include "zstd.h"
 
 namespace mc {
 
-struct DecodingContext;
 class StackAllocator;
 
 class VertexDecompressor {
 public:
+    static constexpr u32 cRingBufferSize = 0x80000;
+
     VertexDecompressor() = default;
 
     void Initialize(u32, ZSTD_DCtx*, StackAllocator*);
     void Finalize();
+    // rewinds the ring buffer + decoding state for a new stream without reallocating them
+    void Reset();
 
     void* ProcessBlock(u8*& dst, ElementType componentType, s32 a3, s32 size, u32 a5, DecompContext& ctx);
 
+    // what carries over from one mesh to the next, minus the ring buffer contents
+    struct State {
+        u32 offset;
+        u32 bufferSize;
+        DecodingContext decodingContext;
+    };
+
+    void SaveState(State& state) const;
+    // the ring buffer gets cleared so that decoding from here on doesn't depend on whatever was in it
+    void RestoreState(const State& state);
+
+    // the ring buffer is also the zstd window for the attribute streams (cRingBufferSize bytes)
+    void SaveRingBuffer(u8* dst) const;
+    void RestoreRingBuffer(const u8* src);
+
 private:
     ZSTD_DCtx* mDCtx;
     u8* mBuffer;
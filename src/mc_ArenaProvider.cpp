@@ -0,0 +1,88 @@
+#include "mc_ArenaProvider.h"
+#include "mc_Types.h"
+
+#include <cstdlib> // std::malloc, std::free
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace mc {
+
+void* MallocArenaProvider::Allocate(size_t size) {
+    return std::malloc(size);
+}
+
+void MallocArenaProvider::Free(void* memory, size_t size [[maybe_unused]]) {
+    std::free(memory);
+}
+
+MallocArenaProvider& GetMallocArenaProvider() {
+    static MallocArenaProvider provider;
+    return provider;
+}
+
+#ifdef __linux__
+
+static void Prefault(u8* memory, size_t size) {
+#ifdef MADV_POPULATE_WRITE
+    // linux 5.14+, faults everything in with a single call
+    if (madvise(memory, size, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    for (size_t offset = 0; offset < size; offset += 0x1000)
+        memory[offset] = 0;
+}
+
+void* HugePageArenaProvider::Allocate(size_t size) {
+    u8* memory = nullptr;
+
+    if (mConfig.useHugeTLB) {
+        // hugetlb mappings are always aligned to the page size
+        void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping != MAP_FAILED)
+            memory = reinterpret_cast<u8*>(mapping);
+    }
+
+    if (memory == nullptr) {
+        // map an extra page worth so there's a 2 MB aligned range in there, then give back whatever's around it
+        const size_t mappingSize = size + cHugePageSize;
+        void* mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED)
+            return nullptr;
+
+        u8* start = reinterpret_cast<u8*>(mapping);
+        memory = reinterpret_cast<u8*>((reinterpret_cast<uintptr_t>(start) + cHugePageSize - 1) & ~(cHugePageSize - 1));
+        if (memory != start)
+            munmap(start, memory - start);
+        if (start + mappingSize != memory + size)
+            munmap(memory + size, start + mappingSize - (memory + size));
+
+        // only a hint, if transparent huge pages are disabled this is a regular mapping
+        madvise(memory, size, MADV_HUGEPAGE);
+    }
+
+    if (mConfig.prefault)
+        Prefault(memory, size);
+
+    return memory;
+}
+
+void HugePageArenaProvider::Free(void* memory, size_t size) {
+    if (memory != nullptr)
+        munmap(memory, size);
+}
+
+#else
+
+void* HugePageArenaProvider::Allocate(size_t size) {
+    return std::malloc(size);
+}
+
+void HugePageArenaProvider::Free(void* memory, size_t size [[maybe_unused]]) {
+    std::free(memory);
+}
+
+#endif
+
+} // namespace mc
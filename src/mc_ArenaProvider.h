@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mc {
+
+// where DecoderSession (and so BatchDecoder) gets its work memory from
+class ArenaProvider {
+public:
+    virtual ~ArenaProvider() = default;
+
+    // how much actually gets allocated for a request of size bytes, sessions use all of it
+    virtual size_t GetAllocationSize(size_t size) const {
+        return size;
+    }
+
+    // size is always a value returned by GetAllocationSize, returns nullptr on failure (the memory doesn't have to be zeroed)
+    virtual void* Allocate(size_t size) = 0;
+    // size is the same as the one passed to Allocate
+    virtual void Free(void* memory, size_t size) = 0;
+};
+
+// std::malloc + std::free, what sessions use when DecodeOptions::arenaProvider isn't set
+class MallocArenaProvider final : public ArenaProvider {
+public:
+    void* Allocate(size_t size) override;
+    void Free(void* memory, size_t size) override;
+};
+
+MallocArenaProvider& GetMallocArenaProvider();
+
+// the codec's scratch buffers (the vertex ring buffer, the index work buffers, the decoding tables...) are spread over a few MB of
+// work memory and get accessed all over the place, so backing it with 2 MB pages instead of 4 KB ones saves a lot of TLB misses
+// allocations are rounded up to and aligned to 2 MB, on anything other than linux this is just a regular allocation
+class HugePageArenaProvider final : public ArenaProvider {
+public:
+    struct Config {
+        // take the pages from the hugetlbfs pool (MAP_HUGETLB, vm.nr_hugepages has to be set up for it) instead of relying on
+        // transparent huge pages (MADV_HUGEPAGE), falls back to transparent huge pages if the pool is empty
+        bool useHugeTLB = false;
+        // touch every page when allocating so that the page faults happen once up front instead of during the first decode
+        bool prefault = true;
+    };
+
+    static constexpr size_t cHugePageSize = 0x200000;
+
+    explicit HugePageArenaProvider(const Config& config) : mConfig(config) {}
+
+    size_t GetAllocationSize(size_t size) const override {
+        return (size + cHugePageSize - 1) & ~(cHugePageSize - 1);
+    }
+
+    void* Allocate(size_t size) override;
+    void Free(void* memory, size_t size) override;
+
+private:
+    Config mConfig;
+};
+
+} // namespace mc
@@ -3,6 +3,7 @@
 
 #include "mc_Float.h"
 
+#include <algorithm> // std::min
 #include <cmath> // std::sqrt
 #include <cstring> // std::memcpy
 #include <type_traits> // std::is_same_v
@@ -2399,6 +2400,65 @@ DecodeAttributeFunc sAttributeDecodeFunctions[0x71] = {
     detail::DecodeFixedDistance<8, true>, detail::DecodeFixedDistance<10, true>, detail::DecodeFixedDistance<16, true>,
 };
 
+static bool IsCrossProduct(DecodeAttributeFunc func) {
+    return func == detail::DecodeCrossProduct<8> || func == detail::DecodeCrossProduct<10> || func == detail::DecodeCrossProduct<16>;
+}
+
+static bool IsTriangleTexCoords(DecodeAttributeFunc func) {
+    return func == detail::DecodeTriangleTexCoords<s16> || func == detail::DecodeTriangleTexCoords<u16>
+        || func == detail::DecodeTriangleTexCoordsFloat<f16> || func == detail::DecodeTriangleTexCoordsFloat<f32>;
+}
+
+// these have to match what the decode functions read
+u32 PeekAttributeReferences(u32 attrFormat, const DecompContext& ctx) {
+    const DecodeAttributeFunc func = sAttributeDecodeFunctions[attrFormat];
+    if (IsCrossProduct(func))
+        return 1u << (ctx.currentPos[0] & 0xf) | 1u << (ctx.currentPos[1] & 0xf);
+    if (IsTriangleTexCoords(func)) {
+        BitStreamReader bitStream = ctx.bitStream0;
+        return 1u << (bitStream.Read(5) >> 1 & 0xf);
+    }
+    return 0;
+}
+
+void SaveAttributeInputs(u32 attrFormat, DecompContext& ctx, DecompContext& saved, u64& storage) {
+    const DecodeAttributeFunc func = sAttributeDecodeFunctions[attrFormat];
+    saved = {};
+    storage = 0;
+    if (IsCrossProduct(func)) {
+        std::memcpy(&storage, ctx.currentPos, 2);
+        ctx.currentPos += 2;
+        saved.currentPos = reinterpret_cast<const u8*>(&storage);
+    } else if (IsTriangleTexCoords(func)) {
+        // a fresh reader returns the top bits of the first word
+        storage = ctx.bitStream0.Read(5) << 59;
+        saved.bitStream0 = BitStreamReader(&storage);
+    }
+}
+
+void SkipAttributeInputs(u32 attrFormat, DecompContext& ctx) {
+    DecompContext saved;
+    u64 storage;
+    SaveAttributeInputs(attrFormat, ctx, saved, storage);
+}
+
+// cross products read three 8, 10 or 16 bit components of their inputs and the triangle texcoords three 8, 10, 16 or 32 bit components
+// of the positions, so nothing else can be referenced, and every decode function that references something writes at least 2 components
+u32 GetAttributeReferenceClosure(const VertexStreamContext& ctx, u32 mask) {
+    u32 referable = 0;
+    bool references = false;
+    for (u32 i = 0; i < std::min(ctx.attrCount, 15u); ++i) {
+        const u32 componentCount = ctx.attrFlags[i] & 7;
+        const u32 componentBitSize = ctx.attrFlags[i] >> 8 & 0xff;
+        if (componentCount >= 3 && (componentBitSize == 8 || componentBitSize == 10 || componentBitSize == 16 || componentBitSize == 32))
+            referable |= 1u << i;
+        if (mask >> i & 1 && componentCount >= 2)
+            references = true;
+    }
+    // referable attributes have 3 components themselves, so anything they reference is already in there
+    return references ? mask | referable : mask;
+}
+
 // this just copies old data, nothing too fancy
 void DecodeBackrefs(VertexStreamContext& ctx, s32 vertexCount [[maybe_unused]], VertexDecodeGroup* groups, u32 numGroups) {
     #define MASK(VALUE, SHIFT, MASK) ((((VALUE) << (SHIFT)) & (MASK)) >> (SHIFT))
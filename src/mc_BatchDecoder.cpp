@@ -0,0 +1,160 @@
+#include "mc_BatchDecoder.h"
+#include "mc_ThreadPool.h"
+
+#include <algorithm> // std::stable_sort, std::max
+
+namespace mc {
+
+BatchDecoder::BatchDecoder(const Config& config) : mConfig(config) {
+    mPool = std::make_unique<ThreadPool>(config.threadCount);
+    mWorkers = std::make_unique<Worker[]>(mPool->GetThreadCount());
+    for (u32 i = 0; i < mPool->GetThreadCount(); ++i)
+        mWorkers[i].session.SetOptions(config.options);
+}
+
+BatchDecoder::~BatchDecoder() {
+    // the workers have to be gone before their sessions are
+    mPool.reset();
+}
+
+u32 BatchDecoder::GetThreadCount() const {
+    return mPool->GetThreadCount();
+}
+
+void BatchDecoder::Acquire(Worker& worker, size_t workMemorySize, size_t outputSize) {
+    std::unique_lock lock(mBudgetMutex);
+    while (true) {
+        // charged for what the session ends up holding, which the arena provider may round up, and since the session keeps its work memory
+        // between jobs only growing it costs anything (asked again every time since other workers may have released it in the meantime)
+        const size_t reservedSize = workMemorySize == 0 ? 0 : worker.session.GetReservedSize(workMemorySize);
+        const size_t growth = reservedSize > worker.chargedWorkMemory ? reservedSize - worker.chargedWorkMemory : 0;
+        const size_t size = growth + outputSize;
+        if (mConfig.memoryBudget == 0 || mMemoryInUse + size <= mConfig.memoryBudget || mMemoryInUse == 0) {
+            mMemoryInUse += size;
+            worker.chargedWorkMemory += growth;
+            worker.inFlight = true;
+            ++mJobsInFlight;
+            mPeakMemoryUsage = std::max(mPeakMemoryUsage, mMemoryInUse);
+            return;
+        }
+
+        if (mJobsInFlight == 0) {
+            // nothing that's running can give anything back, so the only thing left is the work memory idle sessions are holding on to
+            // a worker that picked up a job only touches its session under the lock until it's through here, so any session whose worker
+            // isn't in flight can be released (which with nothing in flight is all of them, the check just keeps it that way)
+            for (u32 i = 0; i < mPool->GetThreadCount(); ++i) {
+                if (mWorkers[i].inFlight)
+                    continue;
+                mMemoryInUse -= mWorkers[i].chargedWorkMemory;
+                mWorkers[i].chargedWorkMemory = 0;
+                mWorkers[i].session.ReleaseWorkMemory();
+            }
+            continue;
+        }
+
+        mBudgetReleased.wait(lock);
+    }
+}
+
+void BatchDecoder::Release(Worker& worker, size_t size) {
+    {
+        std::lock_guard lock(mBudgetMutex);
+        mMemoryInUse -= size;
+        worker.inFlight = false;
+        --mJobsInFlight;
+    }
+    mBudgetReleased.notify_all();
+}
+
+void BatchDecoder::RunJob(u32 workerIndex, size_t jobIndex, const BatchJob& job, const DecodeRequirements& req, BatchResult& result, const CompletionFunc& onComplete) {
+    Worker& worker = mWorkers[workerIndex];
+
+    // quads are decoded with the session's own dctx so they don't need any work memory
+    const size_t workMemorySize = req.type == FileType::Quad ? 0 : worker.session.GetStreamWorkMemorySize(req.workMemorySize);
+    const size_t outputSize = job.dst == nullptr ? req.decompressedSize : 0;
+    Acquire(worker, workMemorySize, outputSize);
+
+    std::unique_ptr<u8[]> ownedOutput;
+    void* dst = job.dst;
+    size_t dstSize = job.dstSize;
+    if (dst == nullptr) {
+        ownedOutput = std::make_unique<u8[]>(req.decompressedSize);
+        dst = ownedOutput.get();
+        dstSize = req.decompressedSize;
+    }
+
+    bool success = worker.session.Reserve(workMemorySize);
+    if (success) {
+        switch (req.type) {
+            case FileType::MeshCodecPackage:
+                success = worker.session.Decode(dst, dstSize, job.src, job.srcSize);
+                break;
+            case FileType::Chunk:
+                success = worker.session.DecodeChunk(dst, dstSize, job.src, job.srcSize);
+                break;
+            case FileType::Quad:
+                success = worker.session.DecodeQuad(dst, dstSize, job.src, job.srcSize);
+                break;
+            default:
+                success = false;
+                break;
+        }
+    }
+    result.success = success;
+    result.decodeResult = worker.session.GetLastResult();
+
+    if (onComplete)
+        onComplete(jobIndex, result, success ? std::span<const u8>(reinterpret_cast<const u8*>(dst), req.decompressedSize) : std::span<const u8>());
+
+    ownedOutput.reset();
+    Release(worker, outputSize);
+}
+
+std::vector<BatchResult> BatchDecoder::Decode(std::span<const BatchJob> jobs, const CompletionFunc& onComplete) {
+    std::vector<BatchResult> results(jobs.size());
+    std::vector<DecodeRequirements> requirements(jobs.size());
+    std::vector<size_t> order;
+    order.reserve(jobs.size());
+
+    {
+        std::lock_guard lock(mBudgetMutex);
+        mPeakMemoryUsage = mMemoryInUse;
+    }
+
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        requirements[i] = QueryRequirements(jobs[i].src, jobs[i].srcSize);
+        results[i] = {
+            .success = false,
+            .type = requirements[i].type,
+            .decompressedSize = requirements[i].decompressedSize,
+            .workMemorySize = requirements[i].workMemorySize,
+            .decodeResult = {},
+        };
+        if (requirements[i].type != FileType::Invalid)
+            order.push_back(i);
+    }
+
+    // files that aren't recognized are reported right away, but from a worker thread like everything else
+    if (onComplete) {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (requirements[i].type == FileType::Invalid)
+                mPool->Submit([i, &results, &onComplete](u32) { onComplete(i, results[i], {}); });
+        }
+    }
+
+    // largest first, the output size is a decent stand-in for how long a file takes to decode
+    std::stable_sort(order.begin(), order.end(), [&requirements](size_t a, size_t b) {
+        return requirements[a].decompressedSize + requirements[a].workMemorySize > requirements[b].decompressedSize + requirements[b].workMemorySize;
+    });
+
+    for (size_t index : order) {
+        mPool->Submit([this, index, &jobs, &requirements, &results, &onComplete](u32 workerIndex) {
+            RunJob(workerIndex, index, jobs[index], requirements[index], results[index], onComplete);
+        });
+    }
+    mPool->Wait();
+
+    return results;
+}
+
+} // namespace mc
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "mc_DecoderSession.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace mc {
+
+class ThreadPool;
+
+struct BatchJob {
+    const void* src;
+    size_t srcSize;
+    void* dst = nullptr;    // output buffer, if this is null the decoder allocates one that's only valid during the completion callback
+    size_t dstSize = 0;
+};
+
+struct BatchResult {
+    bool success;
+    FileType type;
+    size_t decompressedSize;
+    size_t workMemorySize;
+    DecodeResult decodeResult; // what the session reported for this job
+};
+
+// decodes lots of .bfres.mc, chunk and quad files at once on a thread pool while keeping the total amount of work memory
+// and decoder allocated output buffers under a budget (the sizes come from QueryRequirements, so nothing is guessed)
+// the most expensive jobs are started first so one large file doesn't end up running alone at the end of a batch
+class BatchDecoder {
+public:
+    struct Config {
+        u32 threadCount = 0;        // 0 uses one thread per hardware thread
+        size_t memoryBudget = 0;    // 0 means unlimited, a single job larger than the budget still runs but only on its own
+        DecodeOptions options;
+    };
+
+    // called on the worker thread that decoded the job (for jobs QueryRequirements rejects, on whichever worker picks up the report), output is
+    // the decoded data and empty if the job failed
+    using CompletionFunc = std::function<void(size_t jobIndex, const BatchResult& result, std::span<const u8> output)>;
+
+    explicit BatchDecoder(const Config& config);
+    ~BatchDecoder();
+
+    BatchDecoder(const BatchDecoder&) = delete;
+    BatchDecoder& operator=(const BatchDecoder&) = delete;
+
+    // blocks until every job is done, results are in the same order as the jobs
+    std::vector<BatchResult> Decode(std::span<const BatchJob> jobs, const CompletionFunc& onComplete = {});
+
+    u32 GetThreadCount() const;
+
+    // highest amount of budgeted memory in use at once during the last Decode call
+    size_t GetPeakMemoryUsage() const {
+        return mPeakMemoryUsage;
+    }
+
+private:
+    struct Worker {
+        DecoderSession session;
+        size_t chargedWorkMemory = 0; // part of the budget taken up by the session's work memory
+        bool inFlight = false; // between Acquire and Release, nothing else may touch the session then
+    };
+
+    void RunJob(u32 workerIndex, size_t jobIndex, const BatchJob& job, const DecodeRequirements& req, BatchResult& result, const CompletionFunc& onComplete);
+    void Acquire(Worker& worker, size_t workMemorySize, size_t outputSize);
+    void Release(Worker& worker, size_t size);
+
+    Config mConfig;
+    std::unique_ptr<ThreadPool> mPool;
+    std::unique_ptr<Worker[]> mWorkers;
+
+    std::mutex mBudgetMutex; // also guards chargedWorkMemory and inFlight, and the sessions of workers that aren't in flight
+    std::condition_variable mBudgetReleased;
+    size_t mMemoryInUse = 0;
+    size_t mJobsInFlight = 0;
+    size_t mPeakMemoryUsage = 0;
+};
+
+} // namespace mc
@@ -1,11 +1,14 @@
 #include "mc_Codec.h"
 #include "mc_DecompContext.h"
 #include "mc_StackAllocator.h"
+#include "mc_ThreadPool.h"
+#include "mc_MeshSink.h"
 
 #include "mc_Zstd.h"
 #include "mc_IndexCodec.h"
+#include "mc_Float.h"
 
-#include <cstring> // std::memcpy
+#include <cstring> // std::memcpy, std::memset
 
 namespace mc {
 
@@ -27,9 +30,7 @@ void ZStdCodec::Initialize(const StreamContext* indexStream, const StreamContext
     mVertexOutputBuffer = vertexStream->stream;
 }
 
-void MeshCodec::Initialize(const StreamContext* indexStream, const StreamContext* vertexStream, u32 a3, StackAllocator* allocator) {
-    mStackAllocator = allocator;
-    
+void MeshCodec::InitializeStreams(const StreamContext* indexStream, const StreamContext* vertexStream) {
     mIndexStreamContext.baseIndex = 0;
     mIndexStreamContext.indicesRemaining = 0;
     mIndexStreamContext.blocksRemaining = 0;
@@ -56,6 +57,21 @@ void MeshCodec::Initialize(const StreamContext* indexStream, const StreamContext
     mVertexStreamContext.attrCount = 0;
     mVertexStreamContext.totalVertexOutputSize = 0;
 
+    // anything deferred in the previous stream went along with its spilled memory
+    mAttributeMask = DecodeOptions::cAllAttributes;
+    mDecodeMask = DecodeOptions::cAllAttributes;
+    mDeferredAttributeMask = 0;
+    mDeferredAttributes = nullptr;
+    mAttributePool = nullptr;
+    mMeshCallback = nullptr;
+    mMeshCallbackUserData = nullptr;
+}
+
+void MeshCodec::Initialize(const StreamContext* indexStream, const StreamContext* vertexStream, u32 a3, StackAllocator* allocator) {
+    mStackAllocator = allocator;
+
+    InitializeStreams(indexStream, vertexStream);
+
     // the dctx in totk is 0x271f8 but here it's 0x176e0
     // they allocate 0x276d0 per dctx for mc though, not sure if there's a reason for that but let's add the extra just in case
     void* wksp = allocator->Alloc(sizeof(ZSTD_DCtx) + 0x4d8, 8);
@@ -67,6 +83,43 @@ void MeshCodec::Initialize(const StreamContext* indexStream, const StreamContext
     mStage = 0;
 }
 
+void NullCodec::Reset(const StreamContext* indexStream, const StreamContext* vertexStream) {
+    mRemainingIndexSize = indexStream->size;
+    mRemainingVertexSize = vertexStream->size;
+    mIndexOutputBuffer = indexStream->stream;
+    mVertexOutputBuffer = vertexStream->stream;
+}
+
+void ZStdCodec::Reset(const StreamContext* indexStream, const StreamContext* vertexStream) {
+    ZSTD_decompressBegin(mDCtx);
+
+    mRemainingIndexSize = indexStream->size;
+    mRemainingVertexSize = vertexStream->size;
+    mIndexOutputBuffer = indexStream->stream;
+    mVertexOutputBuffer = vertexStream->stream;
+}
+
+void MeshCodec::Reset(const StreamContext* indexStream, const StreamContext* vertexStream) {
+    InitializeStreams(indexStream, vertexStream);
+
+    // the window + entropy tables from the previous stream must not leak into this one
+    ZSTD_decompressBegin(mDCtx);
+
+    mVertexDecompressor.Reset();
+    mIndexDecompressor.Reset();
+
+    mStage = 0;
+}
+
+void MeshCodec::SetAttributeMask(u32 mask) {
+    mAttributeMask = mask;
+    mDecodeMask = mask;
+}
+
+void MeshCodec::SetAttributePool(ThreadPool* pool) {
+    mAttributePool = pool;
+}
+
 void NullCodec::Finalize() {}
 
 void ZStdCodec::Finalize() {
@@ -146,9 +199,86 @@ void ZStdCodec::Decompress(DecompContext& ctx) {
     ctx.currentPos = currentPos;
 }
 
+void MeshCodec::SaveCheckpoint(MeshCodecCheckpoint& checkpoint) const {
+    checkpoint.indexStreamContext = mIndexStreamContext;
+    checkpoint.vertexStreamContext = mVertexStreamContext;
+    mVertexDecompressor.SaveState(checkpoint.vertexDecompressor);
+    mIndexDecompressor.SaveState(checkpoint.indexDecompressor);
+}
+
+void MeshCodec::RestoreCheckpoint(const MeshCodecCheckpoint& checkpoint) {
+    // where the output goes is up to the stream this codec was set up for
+    const StreamContext indexStream = mIndexStreamContext.streamContext;
+    mIndexStreamContext = checkpoint.indexStreamContext;
+    mIndexStreamContext.streamContext = indexStream;
+
+    mVertexStreamContext = checkpoint.vertexStreamContext;
+    mVertexStreamContext.outputBuffer = mVertexOutputBuffer;
+    mVertexStreamContext.indexBufferTable = nullptr;
+    mVertexStreamContext.vertexBufferTable = nullptr;
+    mVertexStreamContext.decompContext = nullptr;
+
+    mVertexDecompressor.RestoreState(checkpoint.vertexDecompressor);
+    mIndexDecompressor.RestoreState(checkpoint.indexDecompressor);
+
+    mStage = 0;
+}
+
+void MeshCodec::SaveWindow(u8* window) const {
+    mVertexDecompressor.SaveRingBuffer(window);
+    mIndexDecompressor.SaveWorkBuffers(window + VertexDecompressor::cRingBufferSize);
+}
+
+void MeshCodec::RestoreWindow(const u8* window) {
+    mVertexDecompressor.RestoreRingBuffer(window);
+    mIndexDecompressor.RestoreWorkBuffers(window + VertexDecompressor::cRingBufferSize);
+}
+
+u32 MeshCodec::GetVertexBuffers(VertexBufferInfo* buffers) const {
+    // same walk over the vertex buffers as for a mesh that reuses the previous vertex format
+    const u32 align = mVertexStreamContext.vertexAlign;
+    u32 count = 0;
+    u32 offset = 0;
+    for (u32 attr = 0; attr < mVertexStreamContext.attrCount && count < 15;) {
+        const u32 flags = mVertexStreamContext.vertexBufferFlags[count];
+        const u32 stride = flags & 0xff;
+        const u32 size = ((flags >> 8 & 0xff) + align + stride * mNumVertices) & ~align;
+        buffers[count++] = { offset, size, stride };
+        offset += size;
+        attr = (flags >> 0x10) + 1;
+    }
+    return count;
+}
+
+u32 MeshCodec::GetVertexAttributes(VertexAttributeInfo* attributes) const {
+    const u32 meshStart = mVertexStreamContext.totalVertexOutputSize - mVertexStreamContext.vertexOutputSize;
+    const u32 count = std::min(mVertexStreamContext.attrCount, 15u);
+    for (u32 i = 0; i < count; ++i) {
+        const u32 flags = mVertexStreamContext.attrFlags[i];
+        const u32 bitOffset = flags >> 0x10 & 0xff;
+        const u32 componentBits = flags >> 0x8 & 0xff;
+        const u32 componentCount = flags & 7;
+        attributes[i] = {
+            .offset = mVertexStreamContext.attrOffsets[i] - meshStart,
+            .stride = flags >> 0x18,
+            .size = (bitOffset + componentBits * componentCount + 7) >> 3,
+            .componentCount = componentCount,
+            .componentBits = componentBits,
+            .bitOffset = bitOffset,
+        };
+    }
+    return count;
+}
+
+void MeshCodec::Resume(DecompContext& ctx, u32 blocksRemaining) {
+    DecompressBlocks(ctx, blocksRemaining);
+}
+
 void MeshCodec::Decompress(DecompContext& ctx) {
-    u32 numBlocks = meshopt::decodeVByte(ctx.currentPos);
+    DecompressBlocks(ctx, meshopt::decodeVByte(ctx.currentPos));
+}
 
+void MeshCodec::DecompressBlocks(DecompContext& ctx, u32 numBlocks) {
     // TODO: maybe there's a better way to handle this control flow
     switch (mStage) {
         case 0: // Decompression Start
@@ -170,6 +300,10 @@ void MeshCodec::Decompress(DecompContext& ctx) {
     STAGE0:
     while (numBlocks) {
         {
+            if (mMeshCallback != nullptr && !mMeshCallback(mMeshCallbackUserData, ctx, numBlocks)) {
+                mStage = 0;
+                return;
+            }
             --numBlocks;
             mHasIndexBuffer = mIndexStreamContext.ParseIndexHeader(ctx);
             u32 vertexCount = meshopt::decodeVByte(ctx.currentPos);
@@ -256,6 +390,9 @@ void MeshCodec::Decompress(DecompContext& ctx) {
 
             mVertexStreamContext.vertexOutputSize = outputOffset - mVertexStreamContext.totalVertexOutputSize;
             mVertexStreamContext.totalVertexOutputSize = outputOffset;
+            // attribute indices mean something else in every mesh, and anything a wanted attribute may read has to be decoded from the first block on
+            if (mAttributeMask != DecodeOptions::cAllAttributes)
+                mDecodeMask = GetAttributeReferenceClosure(mVertexStreamContext, mAttributeMask);
             u32 unk = mVertexStreamContext.maxAttrBitSize < 0x60 ? 15 : 14;
             mMaxVertexCopyCount = 1 << unk;
             mVerticesProcessed = 0;
@@ -403,7 +540,9 @@ void MeshCodec::Decompress(DecompContext& ctx) {
                 u32 groupCount = 0;
                 s32 count = mVertexDecompContext.ProcessVertexBlockGroup(&groups, &groupCount, ctx, &mVertexDecompressor, mVertexStreamContext, vertCount, mStackAllocator);
 
-                if (count == 0) {
+                if (mAttributeMask != DecodeOptions::cAllAttributes || mAttributePool != nullptr) {
+                    ProcessAttribute(ctx, vertCount, groups, groupCount, count);
+                } else if (count == 0) {
                     DecodeBackrefs(mVertexStreamContext, vertCount, groups, groupCount);
                 } else {
                     u32 attrFormat = ctx.bitStream0.Read(7);
@@ -436,6 +575,11 @@ void MeshCodec::Decompress(DecompContext& ctx) {
             }
 
             mVertexDecompContext.Reset(mStackAllocator);
+            if (mDeferredAttributeMask != 0) {
+                if (mAttributePool != nullptr)
+                    DecodeDeferredAttributesOnPool(std::min(mMaxVertexCopyCount, mNumVertices - mVerticesProcessed));
+                ReleaseDeferredAttributes();
+            }
             mVerticesProcessed += std::min(mNumVertices - mVerticesProcessed, mMaxVertexCopyCount);
             if (mVertexStreamContext.vertexBufferTable) {
                 mStackAllocator->Free(mVertexStreamContext.vertexBufferTable);
@@ -459,4 +603,189 @@ void MeshCodec::Decompress(DecompContext& ctx) {
     return;
 }
 
-} // namespace mc
\ No newline at end of file
+// masked out attributes (anything outside of mDecodeMask) still have to be read past: their streams and whatever the decode function reads itself
+// with a thread pool the attributes are copied out of the work memory instead (the streams may also point into the input frame or the vertex
+// stream ring buffer) and get decoded at the end of the block
+void MeshCodec::ProcessAttribute(DecompContext& ctx, s32 vertCount, VertexDecodeGroup* groups, u32 groupCount, s32 count) {
+    const bool wanted = mDecodeMask >> mVertexStreamContext.attrIndex & 1;
+
+    if (count == 0) {
+        if (!wanted)
+            return;
+        if (mAttributePool != nullptr)
+            DeferAttribute(ctx, groups, groupCount, nullptr, 0, 0);
+        else
+            DecodeBackrefs(mVertexStreamContext, vertCount, groups, groupCount);
+        return;
+    }
+
+    u32 attrFormat = ctx.bitStream0.Read(7);
+    u32 attrFlags = mVertexStreamContext.attrFlags[mVertexStreamContext.attrIndex];
+    AttrStreamInfo streamInfo[6];
+
+    s32 streamCount = sAttributeGetStreamInfoFunctions[attrFormat](streamInfo, 6, ctx.currentPos, attrFlags & 7, attrFlags >> 8 & 0xff, count);
+
+    if (streamCount < 1) { // see Decompress
+        sAttributeDecodeFunctions[attrFormat](mVertexStreamContext, vertCount, groups, groupCount, mEncodedAttributeStreams, streamCount);
+        return;
+    }
+
+    for (s32 i = 0; i != streamCount; ++i) {
+        if (streamInfo[i].elementCount == 0) {
+            mEncodedAttributeStreams[i] = reinterpret_cast<u8*>(&mEncodedAttributeStreams[i]);
+            mAttributeStreamAllocations[i] = nullptr;
+        } else {
+            mAttributeStreamAllocations[i] = mVertexDecompressor.ProcessBlock(mEncodedAttributeStreams[i], streamInfo[i].elementType, streamInfo[i].tableCount, streamInfo[i].elementCount, 8, ctx);
+        }
+    }
+
+    if (!wanted)
+        SkipAttributeInputs(attrFormat, ctx);
+    else if (mAttributePool != nullptr)
+        DeferAttribute(ctx, groups, groupCount, streamInfo, streamCount, attrFormat);
+    else
+        sAttributeDecodeFunctions[attrFormat](mVertexStreamContext, vertCount, groups, groupCount, mEncodedAttributeStreams, streamCount);
+
+    for (u32 i = streamCount; i != 0; --i) {
+        mStackAllocator->Free(mAttributeStreamAllocations[i - 1]);
+    }
+}
+
+void MeshCodec::DeferAttribute(DecompContext& ctx, VertexDecodeGroup* groups, u32 groupCount, const AttrStreamInfo* streamInfo, s32 streamCount, u32 attrFormat) {
+    if (mDeferredAttributes == nullptr)
+        mDeferredAttributes = reinterpret_cast<DeferredAttribute*>(mStackAllocator->AllocHeap(sizeof(DeferredAttribute) * 15, alignof(DeferredAttribute)));
+
+    // the groups and streams are only valid until the next attribute
+    const size_t groupsSize = (groupCount * sizeof(VertexDecodeGroup) + 0xf) & ~0xfull;
+    size_t size = groupsSize;
+    for (s32 i = 0; i != streamCount; ++i) {
+        const size_t streamSize = static_cast<size_t>(streamInfo[i].elementCount * streamInfo[i].tableCount) << static_cast<u32>(streamInfo[i].elementType);
+        size += (8 + streamSize + 0xf) & ~0xfull; // same padding as VertexDecompressor::ProcessBlock
+    }
+
+    DeferredAttribute& attr = mDeferredAttributes[mVertexStreamContext.attrIndex];
+    u8* memory = reinterpret_cast<u8*>(mStackAllocator->AllocHeap(size, 0x10));
+    attr.allocation = memory;
+    attr.groups = reinterpret_cast<VertexDecodeGroup*>(memory);
+    attr.groupCount = groupCount;
+    if (groupCount != 0)
+        std::memcpy(memory, groups, groupCount * sizeof(VertexDecodeGroup));
+    memory += groupsSize;
+
+    for (s32 i = 0; i != streamCount; ++i) {
+        if (streamInfo[i].elementCount == 0) {
+            attr.streams[i] = reinterpret_cast<u8*>(&attr.streams[i]);
+            continue;
+        }
+        const size_t streamSize = static_cast<size_t>(streamInfo[i].elementCount * streamInfo[i].tableCount) << static_cast<u32>(streamInfo[i].elementType);
+        std::memcpy(memory, mEncodedAttributeStreams[i], streamSize);
+        std::memset(memory + streamSize, 0, 8); // decode functions may read a little past the end
+        attr.streams[i] = memory;
+        memory += (8 + streamSize + 0xf) & ~0xfull;
+    }
+
+    attr.streamCount = streamCount;
+    attr.attrFormat = attrFormat;
+    if (streamCount != 0)
+        SaveAttributeInputs(attrFormat, ctx, attr.ctx, attr.inputs);
+
+    mDeferredAttributeMask |= 1u << mVertexStreamContext.attrIndex;
+}
+
+void MeshCodec::RunDeferredAttribute(u32 attrIndex, s32 vertCount) const {
+    DeferredAttribute& attr = mDeferredAttributes[attrIndex];
+
+    // decode functions take the attribute and where to read their own inputs from through the stream context
+    VertexStreamContext streamCtx = mVertexStreamContext;
+    streamCtx.attrIndex = attrIndex;
+    streamCtx.decompContext = &attr.ctx;
+
+    if (attr.streamCount == 0)
+        DecodeBackrefs(streamCtx, vertCount, attr.groups, attr.groupCount);
+    else
+        sAttributeDecodeFunctions[attr.attrFormat](streamCtx, vertCount, attr.groups, attr.groupCount, attr.streams, attr.streamCount);
+}
+
+// whether two attributes of the current vertex format may write to the same bytes (packed attributes get written with
+// read-modify-writes of up to 8 bytes, which can reach into the next vertex)
+static bool SharesOutputBytes(const VertexStreamContext& ctx, u32 index0, u32 index1) {
+    // different vertex buffers
+    if (ctx.attrOffsets[index0] - ctx.localAttrOffsets[index0] != ctx.attrOffsets[index1] - ctx.localAttrOffsets[index1])
+        return false;
+
+    const auto getSize = [&ctx](u32 index) -> s32 {
+        const u32 flags = ctx.attrFlags[index];
+        const u32 bitSize = (flags >> 0x10 & 0xff) + (flags >> 8 & 0xff) * (flags & 7);
+        return static_cast<s32>(std::max((bitSize + 7) >> 3, 8u));
+    };
+    const s32 stride = std::max<s32>(ctx.attrFlags[index0] >> 0x18, 1);
+    const s32 start0 = ctx.localAttrOffsets[index0];
+    const s32 start1 = ctx.localAttrOffsets[index1];
+    const s32 size0 = getSize(index0);
+    const s32 size1 = getSize(index1);
+    for (s32 offset = -(size1 / stride + 1) * stride; offset <= (size0 / stride + 1) * stride; offset += stride) {
+        if (start0 < start1 + offset + size1 && start1 + offset < start0 + size0)
+            return true;
+    }
+    return false;
+}
+
+void MeshCodec::DecodeDeferredAttributesOnPool(s32 vertCount) {
+    // only wanted attributes get deferred, which already includes whatever they may reference
+    u32 references[15] = {};
+    const u32 decodeMask = mDeferredAttributeMask;
+    for (u32 i = 0; i < 15; ++i) {
+        if (decodeMask >> i & 1 && mDeferredAttributes[i].streamCount != 0)
+            references[i] = PeekAttributeReferences(mDeferredAttributes[i].attrFormat, mDeferredAttributes[i].ctx);
+    }
+
+    // an attribute waits for the ones it references and for earlier ones that write to the same bytes
+    u32 dependencies[15] = {};
+    for (u32 i = 0; i < 15; ++i) {
+        if (!(decodeMask >> i & 1))
+            continue;
+        dependencies[i] = references[i] & decodeMask & ~(1u << i);
+        for (u32 j = 0; j < i; ++j) {
+            if (decodeMask >> j & 1 && SharesOutputBytes(mVertexStreamContext, i, j))
+                dependencies[i] |= 1u << j;
+        }
+    }
+
+    u32 decoded = 0;
+    while (decoded != decodeMask) {
+        u32 ready = 0;
+        for (u32 i = 0; i < 15; ++i) {
+            if ((decodeMask & ~decoded) >> i & 1 && (dependencies[i] & ~decoded) == 0)
+                ready |= 1u << i;
+        }
+        if (ready == 0) // only with references that go in a circle, which the encoder doesn't produce
+            ready = (decodeMask & ~decoded) & -(decodeMask & ~decoded);
+
+        if ((ready & (ready - 1)) == 0) {
+            RunDeferredAttribute(0x1f - Clz(ready), vertCount);
+        } else {
+            for (u32 i = 0; i < 15; ++i) {
+                if (ready >> i & 1) {
+                    mAttributePool->Submit([this, i, vertCount](u32) {
+                        // same floating point environment as the thread running the stream
+                        const u32 fpuState = detail::InitFPUState();
+                        RunDeferredAttribute(i, vertCount);
+                        detail::SetFPUState(fpuState);
+                    });
+                }
+            }
+            mAttributePool->Wait();
+        }
+        decoded |= ready;
+    }
+}
+
+void MeshCodec::ReleaseDeferredAttributes() {
+    for (u32 i = 0; i < 15; ++i) {
+        if (mDeferredAttributeMask >> i & 1)
+            mStackAllocator->Free(mDeferredAttributes[i].allocation);
+    }
+    mDeferredAttributeMask = 0;
+}
+
+} // namespace mc
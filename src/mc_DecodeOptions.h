@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mc {
+
+class ArenaProvider;
+class MeshSink;
+
+// what the codec's stack allocator does when a stream needs more work memory than it was given
+enum class OverflowPolicy {
+    Exit,   // exit the process (what the game does)
+    Spill,  // allocate the rest on the heap, the stream decodes normally
+    Fail,   // allocate the rest on the heap until the current frame is done, then fail the stream with OutOfMemory
+};
+
+// optional behavior for the decode functions, the defaults match the game
+struct DecodeOptions {
+    // decode the FMSH section of .bfres.mc files on a second thread while the bfres file itself is still being decompressed
+    // this only lowers the latency of a single file, when decoding many files at once it's better to decode several files in parallel instead
+    bool concurrentFMSH = false;
+
+    OverflowPolicy overflowPolicy = OverflowPolicy::Exit;
+    // with Spill or Fail, DecoderSession (and so BatchDecoder) gives a stream at most this much work memory instead of the size in its header
+    // (0 = no limit), e.g. the usual peak usage of your files so only the rare outliers pay for heap allocations
+    size_t maxWorkMemorySize = 0;
+
+    // where DecoderSession (and so BatchDecoder) gets its work memory from, std::malloc if this is null (see mc_ArenaProvider.h)
+    // has to outlive every session using it
+    ArenaProvider* arenaProvider = nullptr;
+
+    // bit i set = decode attribute i of each mesh (in the order they're stored in the vertex format), e.g. 1 for just the positions
+    // the streams of masked out attributes are still read past but their decode functions don't run and their output bytes are left as is
+    // attributes that a wanted attribute may be derived from (like the two inputs of a cross product) get decoded anyway, this goes by the
+    // vertex format of each mesh so it can be a few more than are actually needed
+    uint32_t attributeMask = cAllAttributes;
+
+    // decode the attributes of each vertex block on this many threads (0 or 1 = on the decoding thread), only worth it for large meshes
+    // the streams are still read one attribute after another, the attribute decode functions run in parallel once the block has been read
+    // DecoderSession keeps its threads around, the other functions start and stop them for every call
+    uint32_t attributeThreads = 0;
+
+    // stop decoding the index + vertex buffers at the start of the first mesh past this many meshes (0 = no limit), e.g. 1 for just the
+    // highest LOD of most models, the frames after the one the last mesh ends in aren't read at all
+    uint32_t maxMeshes = 0;
+    // same for once this many bytes of index + vertex data have been written (0 = no limit), the mesh that crosses it is still decoded in full
+    // neither applies to DecoderSession's streaming interface, DecodeResult has where the buffers actually end
+    size_t maxOutputSize = 0;
+
+    // gets every mesh of the index + vertex buffers as soon as it's done (see mc_MeshSink.h), has to outlive the decode
+    // not used by DecoderSession's streaming interface either
+    MeshSink* meshSink = nullptr;
+
+    static constexpr uint32_t cAllAttributes = 0xffffffff;
+};
+
+} // namespace mc
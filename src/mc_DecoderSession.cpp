@@ -0,0 +1,459 @@
+#include "mc_DecoderSession.h"
+#include "mc_ArenaProvider.h"
+#include "mc_MeshCodecDetail.h"
+
+#include "mc_Codec.h"
+#include "mc_Float.h"
+#include "mc_ThreadPool.h"
+
+#include <algorithm> // std::min, std::max
+#include <cstring> // std::memcpy
+
+namespace mc {
+
+DecoderSession::DecoderSession() {
+    mDCtx = ZSTD_createDCtx();
+}
+
+DecoderSession::~DecoderSession() {
+    ZSTD_freeDCtx(mDCtx);
+    ReleaseWorkMemory();
+}
+
+static ArenaProvider* GetArenaProvider(const DecodeOptions& options) {
+    return options.arenaProvider != nullptr ? options.arenaProvider : &GetMallocArenaProvider();
+}
+
+bool DecoderSession::Reserve(size_t workMemorySize) {
+    if (workMemorySize <= mWorkMemorySize)
+        return true;
+
+    ArenaProvider* provider = GetArenaProvider(mOptions);
+    const size_t size = provider->GetAllocationSize(workMemorySize);
+
+    // the allocator + codec lived inside the old buffer so they have to be set up again anyway, freeing it first means the old and the
+    // new buffer never both count against the memory in use (a failed allocation leaves the session without any work memory)
+    ReleaseWorkMemory();
+    void* memory = provider->Allocate(size);
+    if (memory == nullptr)
+        return false;
+
+    mWorkMemory = memory;
+    mWorkMemorySize = size;
+    mWorkMemoryProvider = provider;
+
+    return true;
+}
+
+void DecoderSession::ReleaseWorkMemory() {
+    if (mWorkMemory != nullptr)
+        mWorkMemoryProvider->Free(mWorkMemory, mWorkMemorySize);
+    mWorkMemory = nullptr;
+    mWorkMemorySize = 0;
+    mWorkMemoryProvider = nullptr;
+    mAllocator = nullptr;
+}
+
+size_t DecoderSession::GetReservedSize(size_t workMemorySize) const {
+    if (workMemorySize <= mWorkMemorySize)
+        return mWorkMemorySize;
+
+    return GetArenaProvider(mOptions)->GetAllocationSize(workMemorySize);
+}
+
+size_t DecoderSession::GetStreamWorkMemorySize(size_t workMemSize) const {
+    if (mOptions.overflowPolicy == OverflowPolicy::Exit || mOptions.maxWorkMemorySize == 0)
+        return workMemSize;
+
+    return std::min(workMemSize, std::max(mOptions.maxWorkMemorySize, sizeof(StackAllocator)));
+}
+
+s32 DecoderSession::PrepareAllocator(StreamContext* indexContext, StreamContext* vertexContext, const ResCompressionHeader* compHeader, size_t workMemSize) {
+    if (!Reserve(GetStreamWorkMemorySize(workMemSize)))
+        return static_cast<s32>(Error8);
+
+    // the threads stay around for the next stream
+    if (mOptions.attributeThreads < 2)
+        mAttributePool = nullptr;
+    else if (mAttributePool == nullptr || mAttributePool->GetThreadCount() != mOptions.attributeThreads)
+        mAttributePool = detail::CreateAttributePool(mOptions);
+
+    StackAllocator::InitArg initArg{
+        .indexStream = indexContext,
+        .vertexStream = vertexContext,
+        .workMemory = mWorkMemory,
+        .workMemorySize = mWorkMemorySize,
+        .overflowPolicy = mOptions.overflowPolicy,
+        .attributeMask = mOptions.attributeMask,
+        .attributePool = mAttributePool.get(),
+    };
+
+    if (mAllocator != nullptr && mAllocator->GetCodecType() == compHeader->GetCodecType())
+        return ResetStackAllocator(mAllocator, initArg, compHeader);
+
+    s32 result = CreateStackAllocator(&mAllocator, initArg, compHeader, 8);
+    if (result < 0)
+        mAllocator = nullptr;
+    return result;
+}
+
+u32 DecoderSession::FinishFrames(u32 status) {
+    // a stream that failed partway through never gets to restore the caller's fpu state or free what it spilled
+    if (status != 0 && mAllocator != nullptr) {
+        detail::SetFPUState(mAllocator->GetFPUState());
+        mAllocator->ReleaseOverflow();
+    }
+
+    return status;
+}
+
+u32 DecoderSession::DecodeFMSH(void* dst, size_t dstSize [[maybe_unused]], const void* src, size_t srcSize) {
+    const ResMeshCodecHeader* header = reinterpret_cast<const ResMeshCodecHeader*>(src);
+
+    StreamContext indexContext;
+    StreamContext vertexContext;
+    detail::SetupFMSHStreams(indexContext, vertexContext, dst, header);
+
+    mLastResult = {
+        .workMemorySize = header->workMemSize,
+        .bytesWritten = header->indexOutputSize + header->vertexOutputSize,
+        .indexOutputSize = header->indexOutputSize,
+        .vertexOutputSize = header->vertexOutputSize,
+    };
+
+    s32 result = PrepareAllocator(&indexContext, &vertexContext, &header->compHeader, header->workMemSize);
+
+    return FinishFrames(detail::DecompressFrames(mAllocator, result, src, srcSize, 0x22, mOptions, &mLastResult));
+}
+
+bool DecoderSession::Decode(void* dst, size_t dstSize, const void* src, size_t srcSize) {
+    if (!detail::IsValidPackageHeader(src, srcSize))
+        return false;
+
+    auto header = reinterpret_cast<const ResMeshCodecPackageHeader*>(src);
+
+    const size_t decompressedSize = header->GetDecompressedSize();
+
+    if (dstSize < decompressedSize)
+        return false;
+
+    if (mDCtx == nullptr)
+        return false;
+
+    ZSTD_DCtx_setParameter(mDCtx, ZSTD_d_experimentalParam1, 1);
+
+    // DecodeFMSH starts the result over so the bfres file's size is only added once it's done
+    mLastResult = {};
+    size_t outputSize = 0;
+
+    if (mOptions.concurrentFMSH) {
+        // the FMSH thread only touches the allocator + work memory (+ mLastResult) while this thread only touches the dctx
+        const bool success = detail::DecompressPackageConcurrent(mDCtx, dst, dstSize, src, srcSize, [](void* userData, u8* output, const ResMeshCodecHeader* header, size_t compressedSize) {
+            return reinterpret_cast<DecoderSession*>(userData)->DecodeFMSH(output, header->vertexOutputSize + header->indexOutputSize, header, compressedSize);
+        }, this, outputSize);
+        mLastResult.bytesWritten += outputSize;
+        return success;
+    }
+
+    size_t remaining;
+    const u8* ptr = detail::DecompressPackage(mDCtx, dst, decompressedSize, src, srcSize, remaining, outputSize);
+    if (ptr == nullptr)
+        return false;
+
+    if (!detail::HasFMSHSection(dst)) {
+        mLastResult.bytesWritten = outputSize;
+        return true;
+    }
+
+    auto fmshHeader = reinterpret_cast<const ResMeshCodecHeader*>(Align(ptr, 4));
+
+    if (fmshHeader->magic != ResMeshCodecHeader::cMagic)
+        return false;
+
+    u8* output = detail::PrepareFMSHOutput(dst, dstSize, fmshHeader, decompressedSize);
+
+    const size_t compressedSize = remaining - static_cast<size_t>(reinterpret_cast<const u8*>(fmshHeader) - ptr);
+    const bool success = DecodeFMSH(output, fmshHeader->vertexOutputSize + fmshHeader->indexOutputSize, fmshHeader, compressedSize) == 0;
+    mLastResult.bytesWritten += outputSize;
+    return success;
+}
+
+bool DecoderSession::DecodeChunk(void* dst, size_t dstSize, const void* src, size_t srcSize) {
+    if (srcSize < 0x1c)
+        return false;
+
+    auto header = reinterpret_cast<const ResChunkHeader*>(src);
+
+    if (dstSize < header->decompressedSize)
+        return false;
+
+    StreamContext indexContext;
+    StreamContext vertexContext;
+    detail::SetupChunkStreams(indexContext, vertexContext, dst, header);
+
+    mLastResult = {
+        .workMemorySize = header->workMemSize,
+        .bytesWritten = header->indexOutputSize + header->vertexOutputSize,
+        .indexOutputSize = header->indexOutputSize,
+        .vertexOutputSize = header->vertexOutputSize,
+    };
+
+    s32 result = PrepareAllocator(&indexContext, &vertexContext, &header->compHeader, header->workMemSize);
+
+    return FinishFrames(detail::DecompressFrames(mAllocator, result, src, srcSize, 0x1c, mOptions, &mLastResult)) == 0;
+}
+
+bool DecoderSession::DecodeQuad(void* dst, size_t dstSize, const void* src, size_t srcSize) {
+    if (srcSize < 0x4 || mDCtx == nullptr)
+        return false;
+
+    // first 4 bytes is the crbin id
+    const void* frameHeader = reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(src) + 4);
+
+    const size_t decompressedSize = ZSTD_getFrameContentSize(frameHeader, srcSize - 4);
+
+    if (dstSize < decompressedSize)
+        return false;
+
+    // quads are regular zstd frames, unlike the outer frame of .bfres.mc files
+    ZSTD_DCtx_setParameter(mDCtx, ZSTD_d_experimentalParam1, 0);
+    const size_t result = ZSTD_decompressDCtx(mDCtx, dst, dstSize, frameHeader, srcSize - 4);
+
+    mLastResult = {
+        .bytesWritten = ZSTD_isError(result) ? 0 : result,
+    };
+
+    return !ZSTD_isError(result);
+}
+
+// frame buffers get some zeroed padding on both sides since the bit stream readers load 8 bytes at a time past either end of their stream
+static constexpr size_t cFramePadding = 0x10;
+
+bool DecoderSession::Begin(void* dst, size_t dstSize) {
+    if (dst == nullptr || mDCtx == nullptr)
+        return false;
+
+    mStreamStage = StreamStage::PackageHeader;
+    mStreamOutput = reinterpret_cast<u8*>(dst);
+    mStreamOutputSize = dstSize;
+    mStreamOutputOffset = 0;
+    mStreamDecompressedSize = 0;
+    mStreamInputOffset = 0;
+    mStreamHasFMSH = false;
+    mStagedSize = 0;
+    mNeededSize = sizeof(ResMeshCodecPackageHeader);
+    mRetainedFrames = 0;
+    mLastResult = {};
+    if (mStaging.size() < mNeededSize)
+        mStaging.resize(mNeededSize);
+
+    return true;
+}
+
+const u8* DecoderSession::Gather(const u8*& data, size_t& size, size_t needed, u8* staging, bool allowDirect) {
+    // the whole piece is already there, no need to copy it
+    if (allowDirect && mStagedSize == 0 && size >= needed) {
+        const u8* piece = data;
+        data += needed;
+        size -= needed;
+        mStreamInputOffset += needed;
+        return piece;
+    }
+
+    size_t copySize = std::min(needed - mStagedSize, size);
+    std::memcpy(staging + mStagedSize, data, copySize);
+    data += copySize;
+    size -= copySize;
+    mStagedSize += copySize;
+    mStreamInputOffset += copySize;
+
+    if (mStagedSize != needed)
+        return nullptr;
+
+    mStagedSize = 0;
+    return staging;
+}
+
+u8* DecoderSession::AcquireFrameBuffer(size_t size) {
+    // frames the codec is done with are reused, the ones it still points into are left alone
+    if (mRetainedFrames == mFrameBuffers.size())
+        mFrameBuffers.emplace_back();
+
+    std::vector<u8>& buffer = mFrameBuffers[mRetainedFrames];
+    buffer.assign(size + cFramePadding * 2, 0);
+
+    return buffer.data() + cFramePadding;
+}
+
+bool DecoderSession::BeginFMSH() {
+    auto header = reinterpret_cast<const ResMeshCodecHeader*>(mFMSHHeader);
+
+    if (header->magic != ResMeshCodecHeader::cMagic)
+        return false;
+
+    u8* output = detail::PrepareFMSHOutput(mStreamOutput, mStreamOutputSize, header, mStreamDecompressedSize);
+    detail::SetupFMSHStreams(mStreamIndexContext, mStreamVertexContext, output, header);
+
+    s32 result = PrepareAllocator(&mStreamIndexContext, &mStreamVertexContext, &header->compHeader, header->workMemSize);
+    if (result < 0) {
+        FinishFrames(ConvertResult(static_cast<u64>(result)));
+        return false;
+    }
+
+    mStreamHasFMSH = true;
+    mLastResult.workMemorySize = header->workMemSize;
+    mLastResult.bytesWritten += header->indexOutputSize + header->vertexOutputSize;
+    mLastResult.indexOutputSize = header->indexOutputSize;
+    mLastResult.vertexOutputSize = header->vertexOutputSize;
+    mNeededSize = static_cast<size_t>(result);
+    if (mNeededSize == 0) {
+        mStreamStage = StreamStage::Done;
+    } else {
+        AcquireFrameBuffer(mNeededSize);
+        mStreamStage = StreamStage::FMSHFrames;
+    }
+
+    return true;
+}
+
+bool DecoderSession::Feed(const void* data, size_t size) {
+    const u8* pos = reinterpret_cast<const u8*>(data);
+
+    while (size != 0) {
+        switch (mStreamStage) {
+            case StreamStage::PackageHeader: {
+                const u8* piece = Gather(pos, size, mNeededSize, mStaging.data(), true);
+                if (piece == nullptr)
+                    return true;
+
+                if (!detail::IsValidPackageHeader(piece, mNeededSize)) {
+                    mStreamStage = StreamStage::Error;
+                    return false;
+                }
+
+                mStreamDecompressedSize = reinterpret_cast<const ResMeshCodecPackageHeader*>(piece)->GetDecompressedSize();
+                if (mStreamOutputSize < mStreamDecompressedSize) {
+                    mStreamStage = StreamStage::Error;
+                    return false;
+                }
+
+                ZSTD_DCtx_setParameter(mDCtx, ZSTD_d_experimentalParam1, 1);
+                ZSTD_decompressBegin(mDCtx);
+                mNeededSize = ZSTD_nextSrcSizeToDecompress(mDCtx);
+                mStreamStage = StreamStage::PackageFrame;
+                break;
+            }
+            case StreamStage::PackageFrame: {
+                // the bufferless zstd api wants each header/block in one piece
+                if (mStaging.size() < mNeededSize)
+                    mStaging.resize(mNeededSize);
+                const u8* piece = Gather(pos, size, mNeededSize, mStaging.data(), true);
+                if (piece == nullptr)
+                    return true;
+
+                size_t result = ZSTD_decompressContinue(mDCtx, mStreamOutput + mStreamOutputOffset, mStreamDecompressedSize - mStreamOutputOffset, piece, mNeededSize);
+                if (ZSTD_isError(result)) {
+                    mStreamStage = StreamStage::Error;
+                    return false;
+                }
+                mStreamOutputOffset += result;
+                mLastResult.bytesWritten += result;
+
+                mNeededSize = ZSTD_nextSrcSizeToDecompress(mDCtx);
+                if (mNeededSize != 0)
+                    break;
+
+                // anything past the frame is ignored if there are no meshes, same as DecompressMC
+                if (!detail::HasFMSHSection(mStreamOutput)) {
+                    mStreamStage = StreamStage::Done;
+                    return true;
+                }
+
+                // DecompressMC aligns the pointer, this assumes the file would have been loaded at an aligned address
+                mNeededSize = Align(mStreamInputOffset, 4) - mStreamInputOffset;
+                mStreamStage = mNeededSize != 0 ? StreamStage::FMSHPadding : StreamStage::FMSHHeader;
+                if (mStreamStage == StreamStage::FMSHHeader)
+                    mNeededSize = 0x22;
+                break;
+            }
+            case StreamStage::FMSHPadding: {
+                size_t skipSize = std::min(mNeededSize, size);
+                pos += skipSize;
+                size -= skipSize;
+                mStreamInputOffset += skipSize;
+                mNeededSize -= skipSize;
+                if (mNeededSize == 0) {
+                    mNeededSize = 0x22;
+                    mStreamStage = StreamStage::FMSHHeader;
+                }
+                break;
+            }
+            case StreamStage::FMSHHeader: {
+                if (Gather(pos, size, mNeededSize, mFMSHHeader, false) == nullptr)
+                    return true;
+
+                if (!BeginFMSH()) {
+                    mStreamStage = StreamStage::Error;
+                    return false;
+                }
+                break;
+            }
+            case StreamStage::FMSHFrames: {
+                const u8* piece = Gather(pos, size, mNeededSize, mFrameBuffers[mRetainedFrames].data() + cFramePadding, false);
+                if (piece == nullptr)
+                    return true;
+
+                s32 result = mAllocator->DecompressFrame(piece, mNeededSize);
+                ++mRetainedFrames;
+                ++mLastResult.framesProcessed;
+                detail::RecordPeakUsage(mAllocator, &mLastResult);
+                if (result < 0) {
+                    FinishFrames(ConvertResult(static_cast<u64>(result)));
+                    mStreamStage = StreamStage::Error;
+                    return false;
+                }
+
+                if (!mAllocator->GetCodec()->HasPendingInputReferences())
+                    mRetainedFrames = 0;
+
+                mNeededSize = static_cast<size_t>(result);
+                if (mNeededSize == 0) {
+                    mRetainedFrames = 0;
+                    mStreamStage = StreamStage::Done;
+                } else {
+                    AcquireFrameBuffer(mNeededSize);
+                }
+                break;
+            }
+            case StreamStage::Done:
+                // DecompressFMSH fails if the stream doesn't end with the last frame
+                if (mStreamHasFMSH) {
+                    mStreamStage = StreamStage::Error;
+                    return false;
+                }
+                return true;
+            case StreamStage::Error:
+            default:
+                return false;
+        }
+    }
+
+    return mStreamStage != StreamStage::Error;
+}
+
+bool DecoderSession::Finish() {
+    bool success = mStreamStage == StreamStage::Done;
+
+    // the input ended partway through the FMSH frames
+    if (mStreamStage == StreamStage::FMSHFrames)
+        FinishFrames(0x1c);
+
+    // Feed fails until the next Begin
+    mStreamStage = StreamStage::Error;
+    mStreamOutput = nullptr;
+    mRetainedFrames = 0;
+
+    return success;
+}
+
+} // namespace mc
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "mc_MeshCodec.h"
+
+#include <memory>
+#include <vector>
+
+struct ZSTD_DCtx_s;
+
+namespace mc {
+
+// decodes many files back to back while keeping the zstd context, the work memory and the codec's scratch buffers
+// (zstd workspace, index/vertex ring buffers, decoding context) alive between them
+// after the first file of a given codec type, each call only resets that state instead of setting it up from scratch
+// a session is not thread safe, use one per thread
+class DecoderSession {
+public:
+    DecoderSession();
+    ~DecoderSession();
+
+    DecoderSession(const DecoderSession&) = delete;
+    DecoderSession& operator=(const DecoderSession&) = delete;
+
+    // grows the work memory up front so that decoding files needing at most this much never reallocates
+    // the memory comes from DecodeOptions::arenaProvider (malloc if it's not set)
+    bool Reserve(size_t workMemorySize);
+    // frees the work memory (the next FMSH or chunk stream sets everything up from scratch again)
+    void ReleaseWorkMemory();
+
+    // same as DecompressMC, DecompressChunk and DecompressQuad but without a caller provided work buffer
+    bool Decode(void* dst, size_t dstSize, const void* src, size_t srcSize);
+    bool DecodeChunk(void* dst, size_t dstSize, const void* src, size_t srcSize);
+    bool DecodeQuad(void* dst, size_t dstSize, const void* src, size_t srcSize);
+
+    // same as DecompressFMSH (src points to the FMSH header), returns 0 on success
+    u32 DecodeFMSH(void* dst, size_t dstSize, const void* src, size_t srcSize);
+
+    // push style decoding of .bfres.mc files (concurrentFMSH doesn't apply here since the FMSH section arrives last anyway) for input that arrives in pieces (e.g. while it's still being read from disk)
+    // dst must be at least ResMeshCodecPackageHeader::GetDecompressedSize() bytes, data passed to Feed only has to stay valid during the call
+    // Feed returns false once the stream is known to be malformed, Finish returns whether the whole file was decoded
+    bool Begin(void* dst, size_t dstSize);
+    bool Feed(const void* data, size_t size);
+    bool Finish();
+
+    size_t GetWorkMemorySize() const {
+        return mWorkMemorySize;
+    }
+
+    // what the last Decode*, DecodeFMSH or Begin/Feed/Finish call did (filled in even if it failed, as far as it got)
+    const DecodeResult& GetLastResult() const {
+        return mLastResult;
+    }
+
+    // how much work memory a stream whose header asks for workMemSize actually gets (less than that with DecodeOptions::maxWorkMemorySize)
+    size_t GetStreamWorkMemorySize(size_t workMemSize) const;
+    // how much the session holds after Reserve(workMemorySize), the arena provider may round it up (e.g. to whole huge pages)
+    size_t GetReservedSize(size_t workMemorySize) const;
+
+    void SetOptions(const DecodeOptions& options) {
+        mOptions = options;
+    }
+
+    const DecodeOptions& GetOptions() const {
+        return mOptions;
+    }
+
+private:
+    enum class StreamStage {
+        PackageHeader, PackageFrame, FMSHPadding, FMSHHeader, FMSHFrames, Done, Error
+    };
+
+    s32 PrepareAllocator(StreamContext* indexContext, StreamContext* vertexContext, const ResCompressionHeader* compHeader, size_t workMemSize);
+    u32 FinishFrames(u32 status);
+    const u8* Gather(const u8*& data, size_t& size, size_t needed, u8* staging, bool allowDirect);
+    bool BeginFMSH();
+    u8* AcquireFrameBuffer(size_t size);
+
+    // streaming state
+    StreamStage mStreamStage = StreamStage::Error;
+    u8* mStreamOutput = nullptr;
+    size_t mStreamOutputSize = 0;
+    size_t mStreamOutputOffset = 0;
+    size_t mStreamDecompressedSize = 0;
+    size_t mStreamInputOffset = 0;  // total bytes consumed so far, used for the FMSH header alignment
+    bool mStreamHasFMSH = false;
+    size_t mStagedSize = 0;         // bytes of the current piece gathered so far
+    size_t mNeededSize = 0;         // size of the current piece
+    std::vector<u8> mStaging;
+    alignas(8) u8 mFMSHHeader[0x28];
+    StreamContext mStreamIndexContext;
+    StreamContext mStreamVertexContext;
+    // FMSH frames have to stay where they are while the codec still points into them, so they each get their own buffer
+    std::vector<std::vector<u8>> mFrameBuffers;
+    size_t mRetainedFrames = 0;
+
+    DecodeOptions mOptions;
+    DecodeResult mLastResult;
+    ZSTD_DCtx_s* mDCtx = nullptr;
+    void* mWorkMemory = nullptr;
+    size_t mWorkMemorySize = 0;
+    ArenaProvider* mWorkMemoryProvider = nullptr; // the provider mWorkMemory came from, options can change in the meantime
+    StackAllocator* mAllocator = nullptr; // lives at the start of mWorkMemory once a FMSH or chunk stream has been decoded
+    std::unique_ptr<ThreadPool> mAttributePool; // for DecodeOptions::attributeThreads
+};
+
+} // namespace mc
@@ -5,18 +5,35 @@
 #include "mc_Zstd.h"
 #include "mc_IndexCodec.h"
 
+#include <cstring> // std::memcpy, std::memset
+
 namespace mc {
 
 void IndexDecompressor::Initialize(u32, ZSTD_DCtx* dctx, StackAllocator* allocator) {
     mStackAllocator = allocator;
     mDCtx = dctx;
     mDecompContext = nullptr;
-    mWorkBuffer0.addr = reinterpret_cast<u8*>(allocator->Alloc(0x60010, 8));
+    mWorkBuffer0.addr = reinterpret_cast<u8*>(allocator->Alloc(cWorkBufferSize0, 8));
+    mWorkBuffer0.offset = 0;
+    mWorkBuffer0.capacity = 0x60000;
+    mWorkBuffer0.size = 0x60000;
+    mTrianglesRemaining = 0;
+    mWorkBuffer1.addr = reinterpret_cast<u8*>(allocator->Alloc(cWorkBufferSize1, 8));
+    mWorkBuffer1.offset = 0;
+    mWorkBuffer1.capacity = 0x20000;
+    mWorkBuffer1.size = 0x20000;
+    mNumVertices = 0;
+    mBaseIndex = 0;
+    mInputStream0 = mWorkBuffer0.addr;
+    mInputStream1 = mWorkBuffer1.addr;
+}
+
+void IndexDecompressor::Reset() {
+    mDecompContext = nullptr;
     mWorkBuffer0.offset = 0;
     mWorkBuffer0.capacity = 0x60000;
     mWorkBuffer0.size = 0x60000;
     mTrianglesRemaining = 0;
-    mWorkBuffer1.addr = reinterpret_cast<u8*>(allocator->Alloc(0x20010, 8));
     mWorkBuffer1.offset = 0;
     mWorkBuffer1.capacity = 0x20000;
     mWorkBuffer1.size = 0x20000;
@@ -26,6 +43,47 @@ void IndexDecompressor::Initialize(u32, ZSTD_DCtx* dctx, StackAllocator* allocat
     mInputStream1 = mWorkBuffer1.addr;
 }
 
+void IndexDecompressor::SaveState(State& state) const {
+    state.workBuffers[0] = mWorkBuffer0;
+    state.workBuffers[1] = mWorkBuffer1;
+    state.workBuffers[0].addr = nullptr;
+    state.workBuffers[1].addr = nullptr;
+    state.inputOffsets[0] = static_cast<u32>(mInputStream0 - mWorkBuffer0.addr);
+    state.inputOffsets[1] = static_cast<u32>(mInputStream1 - mWorkBuffer1.addr);
+    state.trianglesRemaining = mTrianglesRemaining;
+    state._54 = _54;
+    state.numVertices = mNumVertices;
+    state.baseIndex = mBaseIndex;
+}
+
+void IndexDecompressor::RestoreState(const State& state) {
+    u8* buffer0 = mWorkBuffer0.addr;
+    u8* buffer1 = mWorkBuffer1.addr;
+    mWorkBuffer0 = state.workBuffers[0];
+    mWorkBuffer1 = state.workBuffers[1];
+    mWorkBuffer0.addr = buffer0;
+    mWorkBuffer1.addr = buffer1;
+    std::memset(buffer0, 0, cWorkBufferSize0);
+    std::memset(buffer1, 0, cWorkBufferSize1);
+    mInputStream0 = buffer0 + state.inputOffsets[0];
+    mInputStream1 = buffer1 + state.inputOffsets[1];
+    mTrianglesRemaining = state.trianglesRemaining;
+    _54 = state._54;
+    mNumVertices = state.numVertices;
+    mBaseIndex = state.baseIndex;
+    mDecompContext = nullptr;
+}
+
+void IndexDecompressor::SaveWorkBuffers(u8* dst) const {
+    std::memcpy(dst, mWorkBuffer0.addr, cWorkBufferSize0);
+    std::memcpy(dst + cWorkBufferSize0, mWorkBuffer1.addr, cWorkBufferSize1);
+}
+
+void IndexDecompressor::RestoreWorkBuffers(const u8* src) {
+    std::memcpy(mWorkBuffer0.addr, src, cWorkBufferSize0);
+    std::memcpy(mWorkBuffer1.addr, src + cWorkBufferSize0, cWorkBufferSize1);
+}
+
 void IndexDecompressor::Finalize() {
     mDCtx = nullptr;
     mStackAllocator->Free(mWorkBuffer1.addr);
@@ -0,0 +1,668 @@
+#include "mc_MeshBlockIndex.h"
+#include "mc_MeshCodecDetail.h"
+#include "mc_Codec.h"
+#include "mc_DecompContext.h"
+#include "mc_Float.h"
+#include "mc_ThreadPool.h"
+
+#include <algorithm> // std::min, std::max, std::count_if, std::find
+#include <cstdlib> // std::malloc, std::free
+#include <cstring> // std::memcpy, std::memset
+
+namespace mc {
+
+struct BlockCheckpoint {
+    FrameCursor cursor;
+    MeshCodecCheckpoint codec;
+};
+
+// the part of a file the codec runs on, a whole .chunk file or the FMSH section of a .bfres.mc file
+struct BlockStream {
+    const u8* src; // the chunk/FMSH header
+    size_t srcSize;
+    const ResCompressionHeader* compHeader;
+    u32 headerSize;
+    u32 workMemSize;
+    FileType type;
+
+    void SetupStreams(StreamContext& indexContext, StreamContext& vertexContext, u8* output) const {
+        if (type == FileType::Chunk)
+            detail::SetupChunkStreams(indexContext, vertexContext, output, reinterpret_cast<const ResChunkHeader*>(src));
+        else
+            detail::SetupFMSHStreams(indexContext, vertexContext, output, reinterpret_cast<const ResMeshCodecHeader*>(src));
+    }
+};
+
+// where the buffers of a stream are relative to its output
+struct OutputLayout {
+    u32 indexBase;
+    u32 indexSize;
+    u32 vertexBase;
+    u32 vertexSize;
+    u32 span;
+
+    OutputLayout(const BlockStream& stream, u8* output) {
+        StreamContext indexContext;
+        StreamContext vertexContext;
+        stream.SetupStreams(indexContext, vertexContext, output);
+        indexBase = static_cast<u32>(indexContext.stream - output);
+        indexSize = indexContext.size;
+        vertexBase = static_cast<u32>(vertexContext.stream - output);
+        vertexSize = vertexContext.size;
+        span = std::max(indexBase + indexSize, vertexBase + vertexSize);
+    }
+};
+
+// one pass over the meshes [block, stopBlock) of a stream
+struct BlockRun {
+    MeshCodec* codec;
+    MeshBlockIndex* record; // gets the checkpoint of every mesh that's reached if set
+    u8* window;             // with record, gets a snapshot of every mesh that isn't a restart point added to it instead
+    u32 block;              // the mesh about to be decoded
+    u32 stopBlock;
+    u32 frame;              // the frame being decoded
+    const u8* frameData;
+    bool stopped;
+};
+
+u32 MeshBlockIndex::GetRestartPointCount() const {
+    return static_cast<u32>(std::count_if(blocks.begin(), blocks.end(), [](const Block& block) { return block.isRestartPoint; }));
+}
+
+u32 MeshBlockIndex::GetSnapshotCount() const {
+    return static_cast<u32>(std::count_if(blocks.begin(), blocks.end(), [](const Block& block) { return block.hasSnapshot; }));
+}
+
+u32 MeshBlockIndex::GetSeekPoint(u32 mesh) const {
+    while (mesh != 0 && !blocks[mesh].isRestartPoint && !blocks[mesh].hasSnapshot)
+        --mesh;
+    return mesh;
+}
+
+static BlockStream GetChunkStream(const void* src, size_t srcSize) {
+    auto header = reinterpret_cast<const ResChunkHeader*>(src);
+    return {
+        .src = reinterpret_cast<const u8*>(src),
+        .srcSize = srcSize,
+        .compHeader = &header->compHeader,
+        .headerSize = 0x1c,
+        .workMemSize = header->workMemSize,
+        .type = FileType::Chunk,
+    };
+}
+
+static BlockStream GetFMSHStream(const ResMeshCodecHeader* header, size_t size) {
+    return {
+        .src = reinterpret_cast<const u8*>(header),
+        .srcSize = size,
+        .compHeader = &header->compHeader,
+        .headerSize = 0x22,
+        .workMemSize = header->workMemSize,
+        .type = FileType::MeshCodecPackage,
+    };
+}
+
+static void SaveSnapshot(const MeshCodec& codec, u8* window, MeshBlockIndex& index, u32 block) {
+    codec.SaveWindow(window);
+
+    // mostly vertex data that hasn't been overwritten yet, compresses well enough even on the fastest level
+    std::vector<u8>& data = index.snapshotData;
+    const size_t offset = data.size();
+    data.resize(offset + ZSTD_compressBound(MeshCodec::cWindowSize));
+    const size_t size = ZSTD_compress(data.data() + offset, data.size() - offset, window, MeshCodec::cWindowSize, 1);
+    if (ZSTD_isError(size)) {
+        data.resize(offset);
+        return;
+    }
+
+    data.resize(offset + size);
+    index.blocks[block].snapshotOffset = offset;
+    index.blocks[block].snapshotSize = static_cast<u32>(size);
+}
+
+static bool LoadSnapshot(const MeshBlockIndex& index, u32 block, std::vector<u8>& window) {
+    const MeshBlockIndex::Block& info = index.blocks[block];
+    window.resize(MeshCodec::cWindowSize);
+    const size_t size = ZSTD_decompress(window.data(), window.size(), index.snapshotData.data() + info.snapshotOffset, info.snapshotSize);
+    return !ZSTD_isError(size) && size == MeshCodec::cWindowSize;
+}
+
+static bool OnMesh(void* userData, const DecompContext& ctx, u32 blocksRemaining) {
+    BlockRun* run = reinterpret_cast<BlockRun*>(userData);
+    if (run->block == run->stopBlock) {
+        run->stopped = true;
+        return false;
+    }
+
+    if (run->record != nullptr && run->window != nullptr) {
+        if (!run->record->blocks[run->block].isRestartPoint)
+            SaveSnapshot(*run->codec, run->window, *run->record, run->block);
+    } else if (run->record != nullptr) {
+        BlockCheckpoint checkpoint;
+        checkpoint.cursor.Save(ctx, run->frameData, blocksRemaining);
+        run->codec->SaveCheckpoint(checkpoint.codec);
+
+        run->record->blocks.push_back({
+            .frame = run->frame,
+            .indexOffset = checkpoint.codec.indexStreamContext.indexOffset,
+            .vertexOffset = checkpoint.codec.vertexStreamContext.totalVertexOutputSize,
+            .isRestartPoint = run->block == 0,
+            .hasSnapshot = false,
+            .snapshotSize = 0,
+            .snapshotOffset = 0,
+        });
+        const u8* bytes = reinterpret_cast<const u8*>(&checkpoint);
+        run->record->checkpoints.insert(run->record->checkpoints.end(), bytes, bytes + sizeof(BlockCheckpoint));
+    }
+
+    ++run->block;
+    return true;
+}
+
+// decodes the meshes [first, stop) of a stream, from the start of the stream if first is 0 or from the checkpoint of first otherwise
+// (with the ring buffers restored from window if it's set)
+// with record set (and first 0), the checkpoint and the frames of every mesh get added to it along the way, or with snapshotBuffer
+// (MeshCodec::cWindowSize bytes) set as well, the snapshots of the meshes that aren't restart points
+static bool DecodeBlocks(u8* output, const BlockStream& stream, void* workMemory, size_t workMemorySize, const MeshBlockIndex& index, u32 first, u32 stop,
+                         const u8* window = nullptr, MeshBlockIndex* record = nullptr, u8* snapshotBuffer = nullptr) {
+    StreamContext indexContext;
+    StreamContext vertexContext;
+    stream.SetupStreams(indexContext, vertexContext, output);
+
+    // a mesh that does depend on the ones before it decodes into garbage when started on its own, better to spill than exit over that
+    StackAllocator::InitArg initArg{
+        .indexStream = &indexContext,
+        .vertexStream = &vertexContext,
+        .workMemory = workMemory,
+        .workMemorySize = std::min<size_t>(stream.workMemSize, workMemorySize),
+        .overflowPolicy = OverflowPolicy::Spill,
+    };
+
+    StackAllocator* allocator;
+    s32 status = CreateStackAllocator(&allocator, initArg, stream.compHeader, 8);
+    if (status < 0)
+        return false;
+    if (allocator->GetCodecType() != CodecType::MeshCodec) {
+        detail::SetFPUState(allocator->GetFPUState());
+        return false;
+    }
+
+    const bool recordFrames = record != nullptr && snapshotBuffer == nullptr;
+    MeshCodec* codec = static_cast<MeshCodec*>(allocator->GetCodec());
+    BlockRun run{
+        .codec = codec,
+        .record = record,
+        .window = snapshotBuffer,
+        .block = first,
+        .stopBlock = stop,
+        .frame = 0,
+        .frameData = stream.src + stream.headerSize,
+        .stopped = false,
+    };
+    codec->SetMeshCallback(OnMesh, &run);
+
+    size_t offset = stream.headerSize;
+    size_t size = static_cast<size_t>(status);
+    if (first == 0) {
+        if (offset + size > stream.srcSize) {
+            detail::SetFPUState(allocator->GetFPUState());
+            return false;
+        }
+        if (recordFrames && size != 0)
+            record->frames.push_back({ static_cast<u32>(offset), static_cast<u32>(size) });
+        status = size != 0 ? allocator->DecompressFrame(run.frameData, size) : 0;
+    } else {
+        BlockCheckpoint checkpoint;
+        std::memcpy(&checkpoint, index.checkpoints.data() + first * sizeof(BlockCheckpoint), sizeof(BlockCheckpoint));
+        codec->RestoreCheckpoint(checkpoint.codec);
+        if (window != nullptr)
+            codec->RestoreWindow(window);
+
+        run.frame = index.blocks[first].frame;
+        offset = index.frames[run.frame].offset;
+        size = index.frames[run.frame].size;
+        run.frameData = stream.src + offset;
+        status = allocator->ResumeFrame(run.frameData, checkpoint.cursor);
+    }
+
+    while (status > 0 && !run.stopped) {
+        offset += size;
+        size = static_cast<size_t>(status);
+        if (offset + size > stream.srcSize)
+            break;
+        ++run.frame;
+        run.frameData = stream.src + offset;
+        if (recordFrames)
+            record->frames.push_back({ static_cast<u32>(offset), static_cast<u32>(size) });
+        status = allocator->DecompressFrame(run.frameData, size);
+    }
+
+    // a run that stopped early or failed leaves the stream partway through
+    if (status != 0) {
+        allocator->ReleaseOverflow();
+        detail::SetFPUState(allocator->GetFPUState());
+        return status > 0 && run.stopped;
+    }
+
+    return run.stopped || offset + size == stream.srcSize;
+}
+
+static bool IsValidChunk(size_t dstSize, const void* src, size_t srcSize) {
+    if (srcSize < 0x1c)
+        return false;
+
+    auto header = reinterpret_cast<const ResChunkHeader*>(src);
+    return dstSize >= header->decompressedSize && header->compHeader.GetCodecType() == CodecType::MeshCodec;
+}
+
+// what the meshes decoded on their own get compared against
+// written bytes start out as the complement of the full decode so anything a mesh copies from earlier output shows up as a mismatch,
+// bytes the decode never writes (alignment padding) start out as 0xff and have to stay that way
+struct ScratchOutput {
+    const u8* output;
+    const u8* written;
+    u8* scratch;
+
+    u8 GetBackground(u32 offset) const {
+        return written[offset] ? static_cast<u8>(~output[offset]) : 0xff;
+    }
+
+    // also puts the range back to the background for the next mesh
+    bool CompareAndReset(u32 start, u32 end) const {
+        bool matches = true;
+        for (u32 i = start; i < end; ++i) {
+            matches = matches && scratch[i] == (written[i] ? output[i] : 0xff);
+            scratch[i] = GetBackground(i);
+        }
+        return matches;
+    }
+};
+
+// decodes [block, next) into the scratch output on its own and checks it against the full decode
+static bool MatchesFullDecode(const ScratchOutput& scratch, const BlockStream& stream, const OutputLayout& layout, void* workMemory,
+                              const MeshBlockIndex& index, u32 block, u32 next, const u8* window) {
+    const u32 blockCount = static_cast<u32>(index.blocks.size());
+    const u32 vertexStart = layout.vertexBase + index.blocks[block].vertexOffset;
+    const u32 vertexEnd = layout.vertexBase + (next == blockCount ? layout.vertexSize : index.blocks[next].vertexOffset);
+    const u32 indexStart = layout.indexBase + index.blocks[block].indexOffset;
+    const u32 indexEnd = layout.indexBase + (next == blockCount ? layout.indexSize : index.blocks[next].indexOffset);
+
+    const bool decoded = DecodeBlocks(scratch.scratch, stream, workMemory, stream.workMemSize, index, block, next, window);
+    const bool vertexMatches = scratch.CompareAndReset(vertexStart, vertexEnd);
+    const bool indexMatches = scratch.CompareAndReset(indexStart, indexEnd);
+    return decoded && vertexMatches && indexMatches;
+}
+
+// both of these walk backwards so the run a block starts always ends at the next block found so far that decoding can start from,
+// which is exactly the run the parallel decode and DecodeMesh give it (or the start of it)
+static void FindRestartPoints(const ScratchOutput& scratch, const BlockStream& stream, const OutputLayout& layout, void* workMemory, MeshBlockIndex& index) {
+    const u32 blockCount = static_cast<u32>(index.blocks.size());
+
+    u32 next = blockCount;
+    for (u32 block = blockCount - 1; block > 0; --block) {
+        if (MatchesFullDecode(scratch, stream, layout, workMemory, index, block, next, nullptr)) {
+            index.blocks[block].isRestartPoint = true;
+            next = block;
+        }
+    }
+}
+
+static void FindSnapshotPoints(const ScratchOutput& scratch, const BlockStream& stream, const OutputLayout& layout, void* workMemory, MeshBlockIndex& index) {
+    const u32 blockCount = static_cast<u32>(index.blocks.size());
+
+    std::vector<u8> window;
+    u32 next = blockCount;
+    for (u32 block = blockCount - 1; block > 0; --block) {
+        MeshBlockIndex::Block& info = index.blocks[block];
+        if (info.isRestartPoint) {
+            next = block;
+            continue;
+        }
+        if (info.snapshotSize == 0 || !LoadSnapshot(index, block, window))
+            continue;
+        if (MatchesFullDecode(scratch, stream, layout, workMemory, index, block, next, window.data())) {
+            info.hasSnapshot = true;
+            next = block;
+        }
+    }
+
+    // only the ones that turned out to work are kept
+    std::vector<u8> data;
+    for (MeshBlockIndex::Block& info : index.blocks) {
+        if (info.hasSnapshot) {
+            const u8* snapshot = index.snapshotData.data() + info.snapshotOffset;
+            info.snapshotOffset = data.size();
+            data.insert(data.end(), snapshot, snapshot + info.snapshotSize);
+        } else {
+            info.snapshotOffset = 0;
+            info.snapshotSize = 0;
+        }
+    }
+    index.snapshotData = std::move(data);
+}
+
+static bool AnalyzeStream(u8* dst, u8* output, const BlockStream& stream, MeshBlockIndex& index, bool snapshots) {
+    const OutputLayout layout(stream, output);
+    index.indexBufferOffset = static_cast<u32>(output - dst) + layout.indexBase;
+    index.indexBufferSize = layout.indexSize;
+    index.vertexBufferOffset = static_cast<u32>(output - dst) + layout.vertexBase;
+    index.vertexBufferSize = layout.vertexSize;
+
+    void* workMemory = std::malloc(stream.workMemSize);
+    if (workMemory == nullptr)
+        return false;
+
+    std::memset(output, 0, layout.span);
+    bool success = DecodeBlocks(output, stream, workMemory, stream.workMemSize, index, 0, static_cast<u32>(-1), nullptr, &index);
+
+    if (success && index.blocks.size() > 1) {
+        // same address mod 0x100 as the output so the vertex buffer of a FMSH stream gets aligned to the same offset
+        std::vector<u8> scratchBuffer(layout.span + 0x100);
+        u8* scratch = scratchBuffer.data() + ((reinterpret_cast<uintptr_t>(output) - reinterpret_cast<uintptr_t>(scratchBuffer.data())) & 0xff);
+
+        // a second decode over a different background tells the padding apart from bytes that happen to decode to 0
+        std::memset(scratch, 0xff, layout.span);
+        success = DecodeBlocks(scratch, stream, workMemory, stream.workMemSize, index, 0, static_cast<u32>(-1));
+
+        std::vector<u8> written(layout.span);
+        for (u32 i = 0; i < layout.span; ++i)
+            written[i] = scratch[i] == output[i];
+        const ScratchOutput scratchOutput{ output, written.data(), scratch };
+        for (u32 i = 0; i < layout.span; ++i)
+            scratch[i] = scratchOutput.GetBackground(i);
+
+        if (success)
+            FindRestartPoints(scratchOutput, stream, layout, workMemory, index);
+
+        // the snapshots come from a third full decode since the ring buffers are only right at the start of a mesh when every mesh before it was decoded
+        if (success && snapshots && index.GetRestartPointCount() != index.blocks.size()) {
+            std::vector<u8> window(MeshCodec::cWindowSize);
+            success = DecodeBlocks(scratch, stream, workMemory, stream.workMemSize, index, 0, static_cast<u32>(-1), nullptr, &index, window.data());
+            for (u32 i = 0; i < layout.span; ++i)
+                scratch[i] = scratchOutput.GetBackground(i);
+
+            if (success)
+                FindSnapshotPoints(scratchOutput, stream, layout, workMemory, index);
+        }
+    }
+
+    std::free(workMemory);
+    return success;
+}
+
+bool AnalyzeChunk(void* dst, size_t dstSize, const void* src, size_t srcSize, MeshBlockIndex& index, bool snapshots) {
+    if (!IsValidChunk(dstSize, src, srcSize))
+        return false;
+
+    index = {};
+    index.type = FileType::Chunk;
+    index.srcSize = srcSize;
+
+    u8* output = reinterpret_cast<u8*>(dst);
+    return AnalyzeStream(output, output, GetChunkStream(src, srcSize), index, snapshots);
+}
+
+bool AnalyzeMC(void* dst, size_t dstSize, const void* src, size_t srcSize, MeshBlockIndex& index, bool snapshots) {
+    if (!detail::IsValidPackageHeader(src, srcSize))
+        return false;
+
+    const size_t decompressedSize = reinterpret_cast<const ResMeshCodecPackageHeader*>(src)->GetDecompressedSize();
+    if (dstSize < decompressedSize)
+        return false;
+
+    index = {};
+    index.type = FileType::MeshCodecPackage;
+    index.srcSize = srcSize;
+
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    ZSTD_DCtx_setParameter(dctx, ZSTD_d_experimentalParam1, 1);
+    size_t remaining;
+    size_t outputSize;
+    const u8* ptr = detail::DecompressPackage(dctx, dst, decompressedSize, src, srcSize, remaining, outputSize);
+    ZSTD_freeDCtx(dctx);
+    if (ptr == nullptr)
+        return false;
+
+    // nothing to index
+    if (!detail::HasFMSHSection(dst))
+        return true;
+
+    auto fmshHeader = reinterpret_cast<const ResMeshCodecHeader*>(Align(ptr, 4));
+    if (reinterpret_cast<const u8*>(fmshHeader) + 0x22 > reinterpret_cast<const u8*>(src) + srcSize || fmshHeader->magic != ResMeshCodecHeader::cMagic)
+        return false;
+
+    index.streamOffset = static_cast<u32>(reinterpret_cast<const u8*>(fmshHeader) - reinterpret_cast<const u8*>(src));
+    u8* output = detail::PrepareFMSHOutput(dst, dstSize, fmshHeader, decompressedSize);
+    return AnalyzeStream(reinterpret_cast<u8*>(dst), output, GetFMSHStream(fmshHeader, srcSize - index.streamOffset), index, snapshots);
+}
+
+// checks everything that gets used as an offset or an index later on
+static bool IsValidIndex(const MeshBlockIndex& index, size_t srcSize) {
+    if (index.srcSize != srcSize || index.checkpoints.size() != index.blocks.size() * sizeof(BlockCheckpoint))
+        return false;
+    if (!index.blocks.empty() && !index.blocks[0].isRestartPoint)
+        return false;
+
+    for (const MeshBlockIndex::Frame& frame : index.frames) {
+        if (static_cast<size_t>(index.streamOffset) + frame.offset + frame.size > srcSize)
+            return false;
+    }
+    for (const MeshBlockIndex::Block& block : index.blocks) {
+        if (block.frame >= index.frames.size() || block.snapshotOffset + block.snapshotSize > index.snapshotData.size())
+            return false;
+    }
+
+    return true;
+}
+
+bool DecompressChunkParallel(void* dst, size_t dstSize, const void* src, size_t srcSize, const MeshBlockIndex& index, u32 threadCount) {
+    if (!IsValidChunk(dstSize, src, srcSize) || index.type != FileType::Chunk || !IsValidIndex(index, srcSize))
+        return false;
+
+    const BlockStream stream = GetChunkStream(src, srcSize);
+    u8* output = reinterpret_cast<u8*>(dst);
+
+    std::vector<u32> restartPoints;
+    for (u32 i = 0; i < index.blocks.size(); ++i) {
+        if (index.blocks[i].isRestartPoint)
+            restartPoints.push_back(i);
+    }
+
+    // the first run also has to cover a stream without any meshes
+    if (restartPoints.empty() || restartPoints[0] != 0)
+        restartPoints.insert(restartPoints.begin(), 0);
+
+    const u32 runCount = static_cast<u32>(restartPoints.size());
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    threadCount = std::min(threadCount, runCount);
+
+    std::vector<void*> workMemory(threadCount, nullptr);
+    bool success = true;
+    for (void*& memory : workMemory) {
+        memory = std::malloc(stream.workMemSize);
+        success = success && memory != nullptr;
+    }
+
+    if (success && threadCount == 1) {
+        success = DecodeBlocks(output, stream, workMemory[0], stream.workMemSize, index, 0, static_cast<u32>(-1));
+    } else if (success) {
+        std::vector<u8> results(runCount, 0);
+        ThreadPool pool(threadCount);
+        for (u32 run = 0; run < runCount; ++run) {
+            const u32 stop = run + 1 < runCount ? restartPoints[run + 1] : static_cast<u32>(-1);
+            pool.Submit([&, run, stop](u32 workerIndex) {
+                results[run] = DecodeBlocks(output, stream, workMemory[workerIndex], stream.workMemSize, index, restartPoints[run], stop);
+            });
+        }
+        pool.Wait();
+        success = std::find(results.begin(), results.end(), 0) == results.end();
+    }
+
+    for (void* memory : workMemory)
+        std::free(memory);
+
+    return success;
+}
+
+bool DecodeMesh(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const MeshBlockIndex& index, u32 mesh) {
+    if (mesh >= index.blocks.size() || !IsValidIndex(index, srcSize) || workBufferSize < sizeof(StackAllocator))
+        return false;
+    if (dstSize < std::max<size_t>(static_cast<size_t>(index.indexBufferOffset) + index.indexBufferSize, static_cast<size_t>(index.vertexBufferOffset) + index.vertexBufferSize))
+        return false;
+
+    BlockStream stream;
+    u8* output;
+    if (index.type == FileType::Chunk) {
+        if (srcSize < 0x1c)
+            return false;
+        stream = GetChunkStream(src, srcSize);
+        output = reinterpret_cast<u8*>(dst) + index.vertexBufferOffset;
+    } else {
+        auto fmshHeader = reinterpret_cast<const ResMeshCodecHeader*>(reinterpret_cast<const u8*>(src) + index.streamOffset);
+        if (static_cast<size_t>(index.streamOffset) + 0x22 > srcSize || fmshHeader->magic != ResMeshCodecHeader::cMagic)
+            return false;
+        stream = GetFMSHStream(fmshHeader, srcSize - index.streamOffset);
+        output = reinterpret_cast<u8*>(dst) + index.indexBufferOffset;
+    }
+
+    const u32 start = index.GetSeekPoint(mesh);
+    std::vector<u8> window;
+    if (index.blocks[start].hasSnapshot && !LoadSnapshot(index, start, window))
+        return false;
+
+    return DecodeBlocks(output, stream, workBuffer, workBufferSize, index, start, mesh + 1, window.empty() ? nullptr : window.data());
+}
+
+// the sidecar file: this header, then the blocks, the frames, the checkpoints (as is) and the snapshot data one after the other
+struct ResMeshBlockIndexHeader {
+    u32 magic; // MBIX
+    u32 version;
+    u32 checkpointSize;
+    u32 type;
+    u64 srcSize;
+    u32 streamOffset;
+    u32 indexBufferOffset;
+    u32 indexBufferSize;
+    u32 vertexBufferOffset;
+    u32 vertexBufferSize;
+    u32 blockCount;
+    u32 frameCount;
+    u32 _34;
+    u64 snapshotDataSize;
+
+    static constexpr u32 cMagic = 0x5849424d;
+    static constexpr u32 cVersion = 1;
+};
+static_assert(sizeof(ResMeshBlockIndexHeader) == 0x40);
+
+struct ResMeshBlock {
+    u32 frame;
+    u32 indexOffset;
+    u32 vertexOffset;
+    u32 flags; // bit 0 = restart point, bit 1 = has snapshot
+    u64 snapshotOffset;
+    u32 snapshotSize;
+    u32 _1c;
+};
+static_assert(sizeof(ResMeshBlock) == 0x20);
+
+static void Append(std::vector<u8>& data, const void* src, size_t size) {
+    const size_t offset = data.size();
+    data.resize(offset + size);
+    if (size != 0)
+        std::memcpy(data.data() + offset, src, size);
+}
+
+void SaveMeshBlockIndex(const MeshBlockIndex& index, std::vector<u8>& data) {
+    const ResMeshBlockIndexHeader header{
+        .magic = ResMeshBlockIndexHeader::cMagic,
+        .version = ResMeshBlockIndexHeader::cVersion,
+        .checkpointSize = sizeof(BlockCheckpoint),
+        .type = static_cast<u32>(index.type),
+        .srcSize = index.srcSize,
+        .streamOffset = index.streamOffset,
+        .indexBufferOffset = index.indexBufferOffset,
+        .indexBufferSize = index.indexBufferSize,
+        .vertexBufferOffset = index.vertexBufferOffset,
+        .vertexBufferSize = index.vertexBufferSize,
+        .blockCount = static_cast<u32>(index.blocks.size()),
+        .frameCount = static_cast<u32>(index.frames.size()),
+        ._34 = 0,
+        .snapshotDataSize = index.snapshotData.size(),
+    };
+
+    data.clear();
+    Append(data, &header, sizeof(header));
+    for (const MeshBlockIndex::Block& block : index.blocks) {
+        const ResMeshBlock resBlock{
+            .frame = block.frame,
+            .indexOffset = block.indexOffset,
+            .vertexOffset = block.vertexOffset,
+            .flags = static_cast<u32>(block.isRestartPoint) | static_cast<u32>(block.hasSnapshot) << 1,
+            .snapshotOffset = block.snapshotOffset,
+            .snapshotSize = block.snapshotSize,
+            ._1c = 0,
+        };
+        Append(data, &resBlock, sizeof(resBlock));
+    }
+    Append(data, index.frames.data(), index.frames.size() * sizeof(MeshBlockIndex::Frame));
+    Append(data, index.checkpoints.data(), index.checkpoints.size());
+    Append(data, index.snapshotData.data(), index.snapshotData.size());
+}
+
+bool LoadMeshBlockIndex(const void* data, size_t size, MeshBlockIndex& index) {
+    if (size < sizeof(ResMeshBlockIndexHeader))
+        return false;
+
+    ResMeshBlockIndexHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != ResMeshBlockIndexHeader::cMagic || header.version != ResMeshBlockIndexHeader::cVersion || header.checkpointSize != sizeof(BlockCheckpoint))
+        return false;
+    if (header.type != static_cast<u32>(FileType::Chunk) && header.type != static_cast<u32>(FileType::MeshCodecPackage))
+        return false;
+
+    const u64 blocksSize = static_cast<u64>(header.blockCount) * sizeof(ResMeshBlock);
+    const u64 framesSize = static_cast<u64>(header.frameCount) * sizeof(MeshBlockIndex::Frame);
+    const u64 checkpointsSize = static_cast<u64>(header.blockCount) * sizeof(BlockCheckpoint);
+    if (size - sizeof(header) != blocksSize + framesSize + checkpointsSize + header.snapshotDataSize)
+        return false;
+
+    index = {};
+    index.type = static_cast<FileType>(header.type);
+    index.srcSize = header.srcSize;
+    index.streamOffset = header.streamOffset;
+    index.indexBufferOffset = header.indexBufferOffset;
+    index.indexBufferSize = header.indexBufferSize;
+    index.vertexBufferOffset = header.vertexBufferOffset;
+    index.vertexBufferSize = header.vertexBufferSize;
+
+    const u8* ptr = reinterpret_cast<const u8*>(data) + sizeof(header);
+    index.blocks.resize(header.blockCount);
+    for (MeshBlockIndex::Block& block : index.blocks) {
+        ResMeshBlock resBlock;
+        std::memcpy(&resBlock, ptr, sizeof(resBlock));
+        ptr += sizeof(resBlock);
+        block = {
+            .frame = resBlock.frame,
+            .indexOffset = resBlock.indexOffset,
+            .vertexOffset = resBlock.vertexOffset,
+            .isRestartPoint = (resBlock.flags & 1) != 0,
+            .hasSnapshot = (resBlock.flags >> 1 & 1) != 0,
+            .snapshotSize = resBlock.snapshotSize,
+            .snapshotOffset = resBlock.snapshotOffset,
+        };
+    }
+
+    index.frames.resize(header.frameCount);
+    std::memcpy(index.frames.data(), ptr, framesSize);
+    ptr += framesSize;
+    index.checkpoints.assign(ptr, ptr + checkpointsSize);
+    ptr += checkpointsSize;
+    index.snapshotData.assign(ptr, ptr + header.snapshotDataSize);
+
+    // srcSize itself can only be checked against the file once it's used
+    return IsValidIndex(index, index.srcSize);
+}
+
+} // namespace mc
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "mc_MeshCodec.h"
+
+#include <vector>
+
+namespace mc {
+
+// where every mesh of a .chunk file or of the FMSH section of a .bfres.mc file starts and where decoding can pick back up from
+// built by AnalyzeChunk/AnalyzeMC and only valid for the exact file it was built from (and the same version of this library)
+struct MeshBlockIndex {
+    struct Block {
+        u32 frame;              // the frame the mesh starts in
+        u32 indexOffset;        // where its indices start in the index buffer
+        u32 vertexOffset;       // where its vertices start in the vertex buffer
+        bool isRestartPoint;    // decoding can start here with an empty zstd window and still give the same output
+        bool hasSnapshot;       // decoding can start here once the codec's ring buffers are restored from its snapshot
+        u32 snapshotSize;       // zstd compressed, in snapshotData
+        u64 snapshotOffset;
+    };
+
+    struct Frame {
+        u32 offset; // from the start of the stream (the chunk or FMSH header)
+        u32 size;
+    };
+
+    FileType type = FileType::Invalid;
+    size_t srcSize = 0;
+    u32 streamOffset = 0;       // where the chunk or FMSH header is in the file
+    // where the index and vertex buffers go in dst (for .bfres.mc files only when dst has the same alignment as the one it was built with)
+    u32 indexBufferOffset = 0;
+    u32 indexBufferSize = 0;
+    u32 vertexBufferOffset = 0;
+    u32 vertexBufferSize = 0;
+    std::vector<Block> blocks;
+    std::vector<Frame> frames;
+    std::vector<u8> checkpoints;    // the codec state at the start of every block, only meaningful to the functions below
+    std::vector<u8> snapshotData;
+
+    u32 GetRestartPointCount() const;
+    u32 GetSnapshotCount() const;
+    // the closest block at or before mesh that decoding can start from
+    u32 GetSeekPoint(u32 mesh) const;
+};
+
+// decodes the chunk into dst (same output as DecompressChunk, with the alignment padding zeroed) while saving the codec state at the start of every mesh, then decodes each mesh
+// again from its saved state with nothing in the zstd window and everything before it in the output scrambled, a mesh whose output still comes
+// out the same doesn't reference anything decoded before it and becomes a restart point
+// with snapshots set, the ring buffers are also saved (compressed) for the meshes in between that decode the same once those are restored,
+// which makes for a much larger index but a lot more places DecodeMesh can start from
+// meshes are assumed to only write to their own part of the output buffers
+// returns false if the chunk couldn't be decoded or isn't MeshCodec compressed
+bool AnalyzeChunk(void* dst, size_t dstSize, const void* src, size_t srcSize, MeshBlockIndex& index, bool snapshots = false);
+
+// same as AnalyzeChunk for the FMSH section of a .bfres.mc file, the whole file gets decoded into dst (same as DecompressMC)
+bool AnalyzeMC(void* dst, size_t dstSize, const void* src, size_t srcSize, MeshBlockIndex& index, bool snapshots = true);
+
+// decodes the chunk with every run of meshes between two restart points decoded on its own thread (0 = one per hardware thread)
+// each thread allocates work memory of the size in the chunk header, so this is only worth it for large chunks with a lot of restart points
+bool DecompressChunkParallel(void* dst, size_t dstSize, const void* src, size_t srcSize, const MeshBlockIndex& index, u32 threadCount);
+
+// decodes a single mesh into the index and vertex buffers in dst, along with the ones between it and the block it has to start from
+// (see GetSeekPoint), nothing else in dst is touched so the rest of a .bfres.mc file has to be decoded separately if it's needed
+// workBuffer should be the work memory size in the chunk/FMSH header
+bool DecodeMesh(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const MeshBlockIndex& index, u32 mesh);
+
+// the sidecar file format for storing an index next to the file it was built from
+void SaveMeshBlockIndex(const MeshBlockIndex& index, std::vector<u8>& data);
+// returns false if the data is malformed or was written by a different version of this library
+bool LoadMeshBlockIndex(const void* data, size_t size, MeshBlockIndex& index);
+
+} // namespace mc
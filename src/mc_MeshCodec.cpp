@@ -1,89 +1,370 @@
 #include "mc_MeshCodec.h"
+#include "mc_MeshCodecDetail.h"
+#include "mc_Codec.h"
+#include "mc_Float.h"
+#include "mc_MeshSink.h"
+#include "mc_ThreadPool.h"
 
-#include "mc_Zstd.h"
+#include <algorithm> // std::min
+#include <thread>
 
 namespace mc {
 
-// nn::util::BinaryFileHeader
-struct BinaryFileHeader {
-    u64 magic;
-    u8 verMicro;
-    u8 verMinor;
-    u16 verMajor;
-    u16 bom;
-    u8 align;
-    u32 filenameOffset;
-    u16 isRelocated;
-    u16 firstBlockOffset;
-    u32 relocationTableOffset;
-    u32 fileSize;
+size_t GetFrameSize(const ResCompressionHeader* header) {
+    return header->sizeInfo.streamOffset.get() + header->sizeInfo.endOffset.get();
+}
+
+namespace detail {
+
+void BeginPackageFrame(ZSTD_DCtx* dctx, PackageFrame& frame, void* dst, size_t dstSize, const void* src, size_t srcSize) {
+    ZSTD_decompressBegin(dctx);
+    frame.input = reinterpret_cast<const u8*>(src) + sizeof(ResMeshCodecPackageHeader);
+    frame.remainingInput = srcSize - sizeof(ResMeshCodecPackageHeader);
+    frame.nextInputSize = 1;
+    frame.output = reinterpret_cast<u8*>(dst);
+    frame.outputOffset = 0;
+    frame.outputCapacity = dstSize;
+}
+
+bool ContinuePackageFrame(ZSTD_DCtx* dctx, PackageFrame& frame, size_t minOutputSize) {
+    while (frame.nextInputSize != 0 && frame.outputOffset < minOutputSize) {
+        if (frame.nextInputSize > frame.remainingInput)
+            return false;
+        size_t result = ZSTD_decompressContinue(dctx, frame.output + frame.outputOffset, frame.outputCapacity - frame.outputOffset, frame.input, frame.nextInputSize);
+        if (ZSTD_isError(result))
+            return false;
+        frame.input += frame.nextInputSize;
+        frame.remainingInput -= frame.nextInputSize;
+        frame.outputOffset += result;
+        frame.nextInputSize = ZSTD_nextSrcSizeToDecompress(dctx);
+    }
+
+    return true;
+}
+
+const u8* DecompressPackage(ZSTD_DCtx* dctx, void* dst, size_t dstSize, const void* src, size_t srcSize, size_t& remaining, size_t& outputSize) {
+    PackageFrame frame;
+    BeginPackageFrame(dctx, frame, dst, dstSize, src, srcSize);
+    if (!ContinuePackageFrame(dctx, frame))
+        return nullptr;
+
+    remaining = frame.remainingInput;
+    outputSize = frame.outputOffset;
+    return frame.input;
+}
+
+bool DecompressPackageConcurrent(ZSTD_DCtx* dctx, void* dst, size_t dstSize, const void* src, size_t srcSize, FMSHDecodeFunc decodeFMSH, void* userData, size_t& outputSize) {
+    const size_t decompressedSize = reinterpret_cast<const ResMeshCodecPackageHeader*>(src)->GetDecompressedSize();
+    const u8* srcEnd = reinterpret_cast<const u8*>(src) + srcSize;
+
+    size_t contentSize;
+    const u8* frameEnd = FindPackageFrameEnd(src, srcSize, contentSize);
+    if (frameEnd == nullptr)
+        return false;
+    auto fmshHeader = reinterpret_cast<const ResMeshCodecHeader*>(Align(frameEnd, 4));
+    const bool hasFMSHHeader = reinterpret_cast<const u8*>(fmshHeader) + 0x22 <= srcEnd && fmshHeader->magic == ResMeshCodecHeader::cMagic;
+
+    // only need the start of the bfres file (the header + the flag HasFMSHSection checks) to know where the FMSH buffers go
+    PackageFrame frame;
+    BeginPackageFrame(dctx, frame, dst, decompressedSize, src, srcSize);
+    if (!ContinuePackageFrame(dctx, frame, 0xf0))
+        return false;
+
+    const size_t fileSize = frame.outputOffset >= 0xf0 ? reinterpret_cast<const BinaryFileHeader*>(dst)->fileSize : 0;
+    const size_t compressedSize = static_cast<size_t>(srcEnd - reinterpret_cast<const u8*>(fmshHeader));
+    // a frame that says it holds more than the bfres file would run into the FMSH output once it's clamped to the file, so it's decoded
+    // the usual way (one after the other) instead
+    const bool fitsFile = frame.outputOffset <= fileSize && (contentSize == 0 || contentSize <= fileSize);
+    if (frame.nextInputSize == 0 || !hasFMSHHeader || !fitsFile || !HasFMSHSection(dst)) {
+        if (!ContinuePackageFrame(dctx, frame))
+            return false;
+        outputSize = frame.outputOffset;
+        if (!HasFMSHSection(dst))
+            return true;
+        if (!hasFMSHHeader)
+            return false;
+        u8* output = PrepareFMSHOutput(dst, dstSize, fmshHeader, decompressedSize);
+        return decodeFMSH(userData, output, fmshHeader, compressedSize) == 0;
+    }
+
+    // everything past the bfres file belongs to the FMSH thread from here on, so it gets cleared up front and the rest of the
+    // zstd frame isn't allowed to write past the file (see the comment in PrepareFMSHOutput)
+    u8* output = PrepareFMSHOutput(dst, dstSize, fmshHeader, decompressedSize);
+    frame.outputCapacity = fileSize;
+
+    u32 fmshResult = 0;
+    std::thread fmshThread([&] {
+        fmshResult = decodeFMSH(userData, output, fmshHeader, compressedSize);
+    });
+    const bool success = ContinuePackageFrame(dctx, frame);
+    fmshThread.join();
+    outputSize = frame.outputOffset;
+
+    return success && fmshResult == 0;
+}
+
+const u8* FindPackageFrameEnd(const void* src, size_t srcSize, size_t& contentSize) {
+    contentSize = 0;
+    if (srcSize < sizeof(ResMeshCodecPackageHeader))
+        return nullptr;
+
+    const u8* frame = reinterpret_cast<const u8*>(src) + sizeof(ResMeshCodecPackageHeader);
+    const u8* end = reinterpret_cast<const u8*>(src) + srcSize;
+
+    ZSTD_frameHeader frameHeader;
+    if (ZSTD_getFrameHeader_advanced(&frameHeader, frame, end - frame, ZSTD_f_zstd1_magicless) != 0)
+        return nullptr;
+    if (frameHeader.frameContentSize != ZSTD_CONTENTSIZE_UNKNOWN)
+        contentSize = frameHeader.frameContentSize;
+
+    const u8* ptr = frame + frameHeader.headerSize;
+    while (true) {
+        if (end - ptr < 3)
+            return nullptr;
+        // 3 byte little endian block header: last block flag, block type, block size
+        const u32 blockHeader = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16);
+        const u32 blockType = blockHeader >> 1 & 3;
+        const size_t blockSize = blockType == 1 ? 1 : blockHeader >> 3; // rle blocks store a single byte
+        if (blockType == 3 || static_cast<size_t>(end - ptr - 3) < blockSize)
+            return nullptr;
+        ptr += 3 + blockSize;
+        if (blockHeader & 1)
+            break;
+    }
+
+    if (frameHeader.checksumFlag) {
+        if (end - ptr < 4)
+            return nullptr;
+        ptr += 4;
+    }
+
+    return ptr;
+}
+
+u8* PrepareFMSHOutput(void* dst, size_t dstSize, const ResMeshCodecHeader* fmshHeader, size_t decompressedSize) {
+    auto fileHeader = reinterpret_cast<const BinaryFileHeader*>(dst);
+
+    // for whatever reason, with some files, ZSTD_decompressContinue writes way past the end of the buffer (even though it returns the correct size)
+    // unsure if this is because Nintendo made changes to the zstd implementation, but we can fix this with a hack by memsetting everything
+    // past the end of the bfres file data to 0 - the game itself doesn't do this but it appears to work fine
+    // it might also be ZSTD versions (totk uses 1.3.7 or something) but that version doesn't have ZSTD_DCtx's definition in a header file
+    // so it'd require some edits to use
+    std::memset(reinterpret_cast<u8*>(dst) + fileHeader->fileSize, 0, dstSize - fileHeader->fileSize);
+    
+    const u32 align = std::max(fmshHeader->vertexAlign, fmshHeader->indexAlign);
+    u8* output = Align(Align(reinterpret_cast<u8*>(dst) + fileHeader->fileSize, 8) + 0x120, align);
+    u32* sizeHeader = reinterpret_cast<u32*>(Align(reinterpret_cast<u8*>(dst) + fileHeader->fileSize, 8));
+    sizeHeader[0] = reinterpret_cast<uintptr_t>(output) - reinterpret_cast<uintptr_t>(dst);
+    sizeHeader[1] = decompressedSize;
+
+    return output;
+}
+
+// follows the meshes of a stream for DecodeOptions::maxMeshes/maxOutputSize/meshSink
+struct MeshTracker {
+    const MeshCodec* codec;
+    const DecodeOptions* options;
+    u32 meshes;         // started so far
+    u32 indexOffset;    // where the current one started
+    u32 vertexOffset;
+    bool stopped;
+
+    // hands the current mesh to the sink, false if the sink wants to stop
+    bool FinishMesh() const {
+        if (options->meshSink == nullptr)
+            return true;
+
+        MeshBlockOutput block{
+            .mesh = meshes - 1,
+            .indices = codec->GetIndexOutput(),
+            .indexOffset = indexOffset,
+            .indexSize = codec->GetIndexOutputOffset() - indexOffset,
+            .indexStride = 0,
+            .indexCount = 0,
+            .vertices = codec->GetVertexOutput(),
+            .vertexOffset = vertexOffset,
+            .vertexSize = codec->GetVertexOutputOffset() - vertexOffset,
+            .vertexCount = 0,
+            .vertexBufferCount = 0,
+            .vertexBuffers = {},
+            .attributeCount = 0,
+            .attributes = {},
+        };
+        if (block.indexSize != 0) {
+            block.indexStride = codec->GetIndexStride();
+            block.indexCount = block.indexStride != 0 ? block.indexSize / block.indexStride : 0;
+        }
+        if (block.vertexSize != 0) {
+            block.vertexCount = codec->GetVertexCount();
+            block.vertexBufferCount = codec->GetVertexBuffers(block.vertexBuffers);
+            block.attributeCount = codec->GetVertexAttributes(block.attributes);
+        }
+        return options->meshSink->OnMeshBlock(block);
+    }
 };
 
-// lazy hack
-static inline bool HasFMSHSection(const void* ptr) {
-    return (*(reinterpret_cast<const u8*>(ptr) + 0xee) >> 3) & 1;
+// the previous mesh is done once the next one starts
+static bool OnMeshStart(void* userData, const DecompContext& ctx [[maybe_unused]], u32 blocksRemaining [[maybe_unused]]) {
+    MeshTracker* tracker = reinterpret_cast<MeshTracker*>(userData);
+    const DecodeOptions& options = *tracker->options;
+    const size_t outputSize = static_cast<size_t>(tracker->codec->GetIndexOutputOffset()) + tracker->codec->GetVertexOutputOffset();
+    if ((tracker->meshes != 0 && !tracker->FinishMesh()) || (options.maxMeshes != 0 && tracker->meshes >= options.maxMeshes) ||
+        (options.maxOutputSize != 0 && outputSize >= options.maxOutputSize)) {
+        tracker->stopped = true;
+        return false;
+    }
+
+    ++tracker->meshes;
+    tracker->indexOffset = tracker->codec->GetIndexOutputOffset();
+    tracker->vertexOffset = tracker->codec->GetVertexOutputOffset();
+    return true;
 }
 
-size_t GetFrameSize(const ResCompressionHeader* header) {
-    return header->sizeInfo.streamOffset.get() + header->sizeInfo.endOffset.get();
+u32 DecompressFrames(StackAllocator* allocator, s32 frameSize, const void* src, size_t srcSize, u32 headerSize, const DecodeOptions& options, DecodeResult* result) {
+    s32 status = frameSize;
+    s32 blockSize = status;
+
+    if (status < 0)
+        return ConvertResult(static_cast<u64>(status));
+
+    u32 offset = headerSize;
+    const u8* pos = reinterpret_cast<const u8*>(src) + headerSize;
+    u32 frames = 0;
+
+    MeshTracker tracker{
+        .codec = nullptr,
+        .options = &options,
+        .meshes = 0,
+        .indexOffset = 0,
+        .vertexOffset = 0,
+        .stopped = false,
+    };
+    MeshCodec* codec = nullptr;
+    if ((options.maxMeshes != 0 || options.maxOutputSize != 0 || options.meshSink != nullptr) && allocator->GetCodecType() == CodecType::MeshCodec) {
+        codec = static_cast<MeshCodec*>(allocator->GetCodec());
+        tracker.codec = codec;
+        codec->SetMeshCallback(OnMeshStart, &tracker);
+    }
+
+    while (status > -1 && blockSize != 0 && !tracker.stopped) {
+        offset += blockSize;
+        status = allocator->DecompressFrame(pos, blockSize);
+        pos += blockSize;
+        blockSize = status;
+        ++frames;
+    }
+
+    if (codec != nullptr) {
+        codec->SetMeshCallback(nullptr, nullptr);
+        // nothing comes after the last mesh to finish it
+        if (status == 0 && !tracker.stopped && tracker.meshes != 0)
+            tracker.FinishMesh();
+    }
+
+    if (result != nullptr) {
+        result->framesProcessed += frames;
+        result->meshesDecoded += tracker.meshes;
+        RecordPeakUsage(allocator, result);
+    }
+
+    if (status > -1 && tracker.stopped) {
+        // the rest of the frames are skipped, normally the last one is what restores the fpu state and frees whatever was spilled
+        if (status != 0) {
+            allocator->ReleaseOverflow();
+            SetFPUState(allocator->GetFPUState());
+        }
+
+        if (result != nullptr) {
+            result->truncated = true;
+            result->bytesWritten -= (result->indexOutputSize - codec->GetIndexOutputOffset()) + (result->vertexOutputSize - codec->GetVertexOutputOffset());
+            result->indexOutputSize = codec->GetIndexOutputOffset();
+            result->vertexOutputSize = codec->GetVertexOutputOffset();
+        }
+        return 0;
+    }
+
+    if (status > -1)
+        return offset != srcSize ? 0x1c : 0;
+
+    // a stream that failed partway through would otherwise keep whatever it spilled until the allocator is reset
+    allocator->ReleaseOverflow();
+
+    return ConvertResult(static_cast<u64>(status));
 }
 
-u32 DecompressFMSH(void* dst, size_t dstSize [[maybe_unused]], const void* src, size_t srcSize, void* workBuffer) {
+std::unique_ptr<ThreadPool> CreateAttributePool(const DecodeOptions& options) {
+    if (options.attributeThreads < 2)
+        return nullptr;
+    return std::make_unique<ThreadPool>(options.attributeThreads);
+}
+
+} // namespace detail
+
+// with a policy that doesn't exit, a work buffer smaller than the header asks for is fine (whatever doesn't fit spills onto the heap)
+static bool FitsWorkBuffer(size_t workMemSize, size_t workBufferSize, OverflowPolicy policy) {
+    return workBufferSize >= workMemSize || (policy != OverflowPolicy::Exit && workBufferSize >= sizeof(StackAllocator));
+}
+
+static u32 DecompressFMSH(void* dst, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const DecodeOptions& options, DecodeResult* decodeResult) {
     const ResMeshCodecHeader* header = reinterpret_cast<const ResMeshCodecHeader*>(src);
 
-    StreamContext indexContext{
-        .stream = reinterpret_cast<u8*>(dst),
-        .size = header->indexOutputSize,
-        .alignment = header->indexAlign,
-    };
-    StreamContext vertexContext{
-        .stream = reinterpret_cast<u8*>((reinterpret_cast<uintptr_t>(dst) + header->vertexAlign + indexContext.size - 1) & -header->vertexAlign),
-        .size = header->vertexOutputSize,
-        .alignment = header->vertexAlign,
-    };
+    StreamContext indexContext;
+    StreamContext vertexContext;
+    detail::SetupFMSHStreams(indexContext, vertexContext, dst, header);
     
+    const std::unique_ptr<ThreadPool> attributePool = detail::CreateAttributePool(options);
+
     StackAllocator::InitArg initArg{
         .indexStream = &indexContext,
         .vertexStream = &vertexContext,
         .workMemory = workBuffer,
-        .workMemorySize = header->workMemSize,
+        .workMemorySize = std::min<size_t>(header->workMemSize, workBufferSize),
+        .overflowPolicy = options.overflowPolicy,
+        .attributeMask = options.attributeMask,
+        .attributePool = attributePool.get(),
     };
 
     StackAllocator* allocator;
     s32 result = CreateStackAllocator(&allocator, initArg, &header->compHeader, 8);
-    s32 blockSize = result;
-
-    if (result > -1) {
-        u32 offset = 0x22;
-        const u8* pos = reinterpret_cast<u8*>(reinterpret_cast<uintptr_t>(src) + 0x22);
-        
-        while (result > -1) {
-            if (blockSize == 0) {
-                return offset != srcSize ? 0x1c : 0;
-            }
-            
-            offset += blockSize;
-            result = allocator->DecompressFrame(pos, blockSize);
-            pos += blockSize;
-            blockSize = result;
-        }
+
+    if (decodeResult != nullptr) {
+        decodeResult->workMemorySize = header->workMemSize;
+        decodeResult->bytesWritten += header->indexOutputSize + header->vertexOutputSize;
+        decodeResult->indexOutputSize = header->indexOutputSize;
+        decodeResult->vertexOutputSize = header->vertexOutputSize;
     }
 
-    return ConvertResult(static_cast<u64>(result));
+    return detail::DecompressFrames(allocator, result, src, srcSize, 0x22, options, decodeResult);
+}
+
+u32 DecompressFMSH(void* dst, size_t dstSize [[maybe_unused]], const void* src, size_t srcSize, void* workBuffer) {
+    return DecompressFMSH(dst, src, srcSize, workBuffer, reinterpret_cast<const ResMeshCodecHeader*>(src)->workMemSize, DecodeOptions{}, nullptr);
 }
 
 bool DecompressMC(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize) {
-    if (srcSize < 0xc || src == nullptr)
-        return false;
+    return DecompressMC(dst, dstSize, src, srcSize, workBuffer, workBufferSize, DecodeOptions{});
+}
 
-    auto header = reinterpret_cast<const ResMeshCodecPackageHeader*>(src);
+struct FMSHWorkBuffer {
+    void* workBuffer;
+    size_t workBufferSize;
+    const DecodeOptions* options;
+    DecodeResult* result;
+};
 
-    if (header->magic != ResMeshCodecPackageHeader::cMagic)
-        return false;
+static u32 DecompressFMSHWithWorkBuffer(void* userData, u8* output, const ResMeshCodecHeader* header, size_t compressedSize) {
+    auto buffer = reinterpret_cast<const FMSHWorkBuffer*>(userData);
+    if (!FitsWorkBuffer(header->workMemSize, buffer->workBufferSize, buffer->options->overflowPolicy))
+        return 0x1c;
+    return DecompressFMSH(output, header, compressedSize, buffer->workBuffer, buffer->workBufferSize, *buffer->options, buffer->result);
+}
 
-    if (header->versionMajor != 0 || header->versionMinor > 1)
+bool DecompressMC(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const DecodeOptions& options, DecodeResult* result) {
+    if (!detail::IsValidPackageHeader(src, srcSize))
         return false;
 
+    auto header = reinterpret_cast<const ResMeshCodecPackageHeader*>(src);
+
     const size_t decompressedSize = header->GetDecompressedSize();
 
     if (dstSize < decompressedSize)
@@ -91,59 +372,54 @@ bool DecompressMC(void* dst, size_t dstSize, const void* src, size_t srcSize, vo
 
     ZSTD_DCtx* dctx = ZSTD_createDCtx();
     ZSTD_DCtx_setParameter(dctx, ZSTD_d_experimentalParam1, 1);
-    ZSTD_decompressBegin(dctx);
-    size_t size = 1;
-    size_t result = 0;
-    size_t remaining = srcSize - sizeof(ResMeshCodecPackageHeader);
-    size_t remainingOutput = decompressedSize;
-    const u8* ptr = reinterpret_cast<const u8*>(src) + sizeof(ResMeshCodecPackageHeader);
-    u8* output = reinterpret_cast<u8*>(dst);
-    do {
-        result = ZSTD_decompressContinue(dctx, output, remainingOutput, ptr, size);
-        if (ZSTD_isError(result))
-            return false;
-        ptr += size;
-        remaining -= size;
-        size = ZSTD_nextSrcSizeToDecompress(dctx);
-        output += result;
-        remainingOutput -= result;
-    } while (size != 0);
+
+    if (result != nullptr)
+        *result = {};
+
+    size_t outputSize = 0;
+    if (options.concurrentFMSH) {
+        FMSHWorkBuffer buffer{ workBuffer, workBufferSize, &options, result };
+        const bool success = detail::DecompressPackageConcurrent(dctx, dst, dstSize, src, srcSize, DecompressFMSHWithWorkBuffer, &buffer, outputSize);
+        ZSTD_freeDCtx(dctx);
+        if (result != nullptr)
+            result->bytesWritten += outputSize;
+        return success;
+    }
+
+    size_t remaining;
+    const u8* ptr = detail::DecompressPackage(dctx, dst, decompressedSize, src, srcSize, remaining, outputSize);
     ZSTD_freeDCtx(dctx);
+    if (ptr == nullptr)
+        return false;
 
-    if (!HasFMSHSection(dst))
-        return true;
+    if (result != nullptr)
+        result->bytesWritten = outputSize;
 
-    auto fileHeader = reinterpret_cast<const BinaryFileHeader*>(dst);
+    if (!detail::HasFMSHSection(dst))
+        return true;
 
     auto fmshHeader = reinterpret_cast<const ResMeshCodecHeader*>(Align(ptr, 4));
 
     if (fmshHeader->magic != ResMeshCodecHeader::cMagic)
         return false;
     
-    // for whatever reason, with some files, ZSTD_decompressContinue writes way past the end of the buffer (even though it returns the correct size)
-    // unsure if this is because Nintendo made changes to the zstd implementation, but we can fix this with a hack by memsetting everything
-    // past the end of the bfres file data to 0 - the game itself doesn't do this but it appears to work fine
-    // it might also be ZSTD versions (totk uses 1.3.7 or something) but that version doesn't have ZSTD_DCtx's definition in a header file
-    // so it'd require some edits to use
-    std::memset(reinterpret_cast<u8*>(dst) + fileHeader->fileSize, 0, dstSize - fileHeader->fileSize);
-    
-    const u32 align = std::max(fmshHeader->vertexAlign, fmshHeader->indexAlign);
-    output = Align(Align(reinterpret_cast<u8*>(dst) + fileHeader->fileSize, 8) + 0x120, align);
-    u32* sizeHeader = reinterpret_cast<u32*>(Align(reinterpret_cast<u8*>(dst) + fileHeader->fileSize, 8));
-    sizeHeader[0] = reinterpret_cast<uintptr_t>(output) - reinterpret_cast<uintptr_t>(dst);
-    sizeHeader[1] = decompressedSize;
+    u8* output = detail::PrepareFMSHOutput(dst, dstSize, fmshHeader, decompressedSize);
 
-    if (workBufferSize < fmshHeader->workMemSize)
+    if (!FitsWorkBuffer(fmshHeader->workMemSize, workBufferSize, options.overflowPolicy))
         return false;
     
     const size_t compressedSize = remaining - static_cast<size_t>(reinterpret_cast<const u8*>(fmshHeader) - ptr);
-    if (DecompressFMSH(output, fmshHeader->vertexOutputSize + fmshHeader->indexOutputSize, fmshHeader, compressedSize, workBuffer)) // 0 == success
+    if (DecompressFMSH(output, fmshHeader, compressedSize, workBuffer, workBufferSize, options, result)) // 0 == success
         return false;
 
     return true;
 }
 
 bool DecompressChunk(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize) {
+    return DecompressChunk(dst, dstSize, src, srcSize, workBuffer, workBufferSize, DecodeOptions{});
+}
+
+bool DecompressChunk(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const DecodeOptions& options, DecodeResult* result) {
     if (srcSize < 0x1c)
         return false;
     
@@ -154,49 +430,112 @@ bool DecompressChunk(void* dst, size_t dstSize, const void* src, size_t srcSize,
     if (dstSize < decompressedSize)
         return false;
     
-    if (workBufferSize < header->workMemSize)
+    if (!FitsWorkBuffer(header->workMemSize, workBufferSize, options.overflowPolicy))
         return false;
 
-    StreamContext indexContext{
-        .stream = reinterpret_cast<u8*>(dst) + header->vertexOutputSize,
-        .size = header->indexOutputSize,
-        .alignment = 2,
-    };
+    StreamContext indexContext;
+    StreamContext vertexContext;
+    detail::SetupChunkStreams(indexContext, vertexContext, dst, header);
 
-    StreamContext vertexContext{
-        .stream = reinterpret_cast<u8*>(dst),
-        .size = header->vertexOutputSize,
-        .alignment = 4,
-    };
+    const std::unique_ptr<ThreadPool> attributePool = detail::CreateAttributePool(options);
 
     StackAllocator::InitArg initArg{
         .indexStream = &indexContext,
         .vertexStream = &vertexContext,
         .workMemory = workBuffer,
-        .workMemorySize = header->workMemSize,
+        .workMemorySize = std::min<size_t>(header->workMemSize, workBufferSize),
+        .overflowPolicy = options.overflowPolicy,
+        .attributeMask = options.attributeMask,
+        .attributePool = attributePool.get(),
     };
 
+    if (result != nullptr) {
+        *result = {
+            .workMemorySize = header->workMemSize,
+            .bytesWritten = header->indexOutputSize + header->vertexOutputSize,
+            .indexOutputSize = header->indexOutputSize,
+            .vertexOutputSize = header->vertexOutputSize,
+        };
+    }
+
     StackAllocator* allocator;
-    s32 result = CreateStackAllocator(&allocator, initArg, &header->compHeader, 8);
-    s32 blockSize = result;
-
-    if (result > -1) {
-        u32 offset = 0x1c;
-        const u8* pos = reinterpret_cast<u8*>(reinterpret_cast<uintptr_t>(src) + 0x1c);
-        
-        while (result > -1) {
-            if (blockSize == 0) {
-                return offset == srcSize;
+    s32 frameSize = CreateStackAllocator(&allocator, initArg, &header->compHeader, 8);
+
+    return detail::DecompressFrames(allocator, frameSize, src, srcSize, 0x1c, options, result) == 0;
+}
+
+FileType DetectFileType(const void* src, size_t srcSize) {
+    if (src == nullptr || srcSize < 4)
+        return FileType::Invalid;
+
+    if (*reinterpret_cast<const u32*>(src) == ResMeshCodecPackageHeader::cMagic)
+        return FileType::MeshCodecPackage;
+
+    // first 4 bytes is the crbin id followed by a regular zstd frame
+    if (srcSize >= 8 && *reinterpret_cast<const u32*>(reinterpret_cast<const u8*>(src) + 4) == ZSTD_MAGICNUMBER)
+        return FileType::Quad;
+
+    if (srcSize >= 0x1c && reinterpret_cast<const ResChunkHeader*>(src)->compHeader.GetCodecType() != CodecType::Invalid)
+        return FileType::Chunk;
+
+    return FileType::Invalid;
+}
+
+DecodeRequirements QueryRequirements(const void* src, size_t srcSize) {
+    DecodeRequirements req{
+        .type = FileType::Invalid,
+        .workMemorySize = 0,
+        .decompressedSize = 0,
+        .fileSize = 0,
+        .indexOutputSize = 0,
+        .vertexOutputSize = 0,
+    };
+
+    switch (DetectFileType(src, srcSize)) {
+        case FileType::MeshCodecPackage: {
+            if (!detail::IsValidPackageHeader(src, srcSize))
+                return req;
+
+            const u8* ptr = detail::FindPackageFrameEnd(src, srcSize, req.fileSize);
+            if (ptr == nullptr)
+                return req;
+
+            req.decompressedSize = reinterpret_cast<const ResMeshCodecPackageHeader*>(src)->GetDecompressedSize();
+
+            // same lookup as DecompressMC, a file without an FMSH section just ends here
+            auto fmshHeader = reinterpret_cast<const ResMeshCodecHeader*>(Align(ptr, 4));
+            if (reinterpret_cast<const u8*>(fmshHeader) + 0x22 <= reinterpret_cast<const u8*>(src) + srcSize
+                && fmshHeader->magic == ResMeshCodecHeader::cMagic) {
+                req.workMemorySize = fmshHeader->workMemSize;
+                req.indexOutputSize = fmshHeader->indexOutputSize;
+                req.vertexOutputSize = fmshHeader->vertexOutputSize;
             }
-            
-            offset += blockSize;
-            result = allocator->DecompressFrame(pos, blockSize);
-            pos += blockSize;
-            blockSize = result;
+
+            req.type = FileType::MeshCodecPackage;
+            return req;
+        }
+        case FileType::Chunk: {
+            auto header = reinterpret_cast<const ResChunkHeader*>(src);
+            req.workMemorySize = header->workMemSize;
+            req.decompressedSize = header->decompressedSize;
+            req.indexOutputSize = header->indexOutputSize;
+            req.vertexOutputSize = header->vertexOutputSize;
+            req.type = FileType::Chunk;
+            return req;
         }
+        case FileType::Quad: {
+            const u64 contentSize = ZSTD_getFrameContentSize(reinterpret_cast<const u8*>(src) + 4, srcSize - 4);
+            if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR)
+                return req;
+            req.workMemorySize = ZSTD_estimateDCtxSize();
+            req.decompressedSize = static_cast<size_t>(contentSize);
+            req.type = FileType::Quad;
+            return req;
+        }
+        case FileType::Invalid:
+        default:
+            return req;
     }
-
-    return ConvertResult(static_cast<u64>(result)) == 0;
 }
 
 bool DecompressQuad(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "include/mc_StackAllocator.h"
+#include "mc_DecodeOptions.h"
 
 namespace mc {
 
@@ -39,8 +40,23 @@ struct ResMeshCodecPackageHeader {
 // 0x7100da3958 on 1.2.1
 // src is a pointer to header struct above, decompresses just the vertex + index buffers
 u32 DecompressFMSH(void* dst, size_t dstSize [[maybe_unused]], const void* src, size_t srcSize, void* workBuffer);
+// what a decode actually did, mostly for figuring out how much work memory files really need
+struct DecodeResult {
+    size_t workMemorySize = 0;      // work memory the header asks for (0 if there was no FMSH section)
+    size_t peakWorkMemoryUsage = 0; // most of the work memory in use at once, including the allocator and the codec
+    size_t peakSpilledSize = 0;     // most heap memory in use at once by allocations that didn't fit (see OverflowPolicy)
+    size_t bytesWritten = 0;        // bfres file + index and vertex buffers (or just the buffers for chunks)
+    u32 framesProcessed = 0;        // mesh codec frames, not counting the zstd frame of .bfres.mc files
+    u32 meshesDecoded = 0;          // only counted with DecodeOptions::maxMeshes, maxOutputSize or meshSink set
+    bool truncated = false;         // one of those limits stopped the buffers early, everything past the sizes below is left as is
+    u32 indexOutputSize = 0;        // how much of the index and vertex buffers got written
+    u32 vertexOutputSize = 0;
+};
+
 // this decompresses a full .bfres.mc file
 bool DecompressMC(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize);
+// with options.overflowPolicy set to Spill or Fail, workBuffer may be smaller than the FMSH header's workMemSize
+bool DecompressMC(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const DecodeOptions& options, DecodeResult* result = nullptr);
 
 // the following is for .chunk files (note that cave page files can be compressed either using ZStd or MeshCodec which is defined in the .crbin file)
 // in the base game, all .chunk files are MC-compressed while all .quad files are ZStd-compressed
@@ -55,6 +71,29 @@ struct ResChunkHeader {
 };
 
 bool DecompressChunk(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize);
+bool DecompressChunk(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize, const DecodeOptions& options, DecodeResult* result = nullptr);
 bool DecompressQuad(void* dst, size_t dstSize, const void* src, size_t srcSize, void* workBuffer, size_t workBufferSize);
 
+// the following is for figuring out how much memory a file needs before decompressing it
+
+enum class FileType {
+    Invalid, MeshCodecPackage, Chunk, Quad
+};
+
+struct DecodeRequirements {
+    FileType type;
+    size_t workMemorySize;      // work buffer size needed by the Decompress function for this type (0 if a .bfres.mc file has no FMSH section)
+    size_t decompressedSize;    // dst size needed by the Decompress function for this type
+    size_t fileSize;            // size of the bfres file itself in a .bfres.mc file (0 if the zstd frame doesn't record it)
+    size_t indexOutputSize;
+    size_t vertexOutputSize;
+};
+
+// guesses the file type from the header (there's no magic for chunks so anything that isn't a .bfres.mc file or a quad and has a valid codec is treated as one)
+FileType DetectFileType(const void* src, size_t srcSize);
+
+// reads only the headers (for .bfres.mc files the outer zstd frame's block headers are walked to find the FMSH header, nothing gets decompressed)
+// type is FileType::Invalid if the input is malformed
+DecodeRequirements QueryRequirements(const void* src, size_t srcSize);
+
 } // namespace mc
\ No newline at end of file
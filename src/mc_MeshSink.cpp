@@ -0,0 +1,193 @@
+#include "mc_MeshSink.h"
+#include "mc_Types.h"
+
+#include <algorithm>
+#include <cstring> // std::memcpy
+#include <type_traits>
+
+namespace mc {
+
+template <size_t Size>
+static void CopyAttribute(uint8_t* dst, const uint8_t* src, uint32_t stride, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i)
+        std::memcpy(dst + i * Size, src + i * stride, Size);
+}
+
+// the sizes the attributes usually come in get a fixed size copy
+static void CopyAttribute(uint8_t* dst, const uint8_t* src, uint32_t size, uint32_t stride, uint32_t count) {
+    switch (size) {
+        case 1: return CopyAttribute<1>(dst, src, stride, count);
+        case 2: return CopyAttribute<2>(dst, src, stride, count);
+        case 4: return CopyAttribute<4>(dst, src, stride, count);
+        case 6: return CopyAttribute<6>(dst, src, stride, count);
+        case 8: return CopyAttribute<8>(dst, src, stride, count);
+        case 12: return CopyAttribute<12>(dst, src, stride, count);
+        case 16: return CopyAttribute<16>(dst, src, stride, count);
+        default:
+            for (uint32_t i = 0; i < count; ++i)
+                std::memcpy(dst + i * size, src + i * stride, size);
+            return;
+    }
+}
+
+template <AttributeFormat Format>
+static constexpr uint32_t cComponentSize = Format == AttributeFormat::Unorm8 || Format == AttributeFormat::Snorm8 ? 1
+                                         : Format == AttributeFormat::Unorm10_10_10_2 || Format == AttributeFormat::Snorm10_10_10_2 ? 4 : 2;
+
+// always all 4 components with fixed size loops so the compiler can vectorize them, only the ones that exist get read and stored
+template <AttributeFormat Format>
+static inline void LoadComponents(const uint8_t* src, uint32_t componentCount, f32 (&out)[4]) {
+    if constexpr (Format == AttributeFormat::Unorm10_10_10_2 || Format == AttributeFormat::Snorm10_10_10_2) {
+        u32 packed = 0;
+        std::memcpy(&packed, src, std::min((componentCount * 10 + 7) >> 3, 4u));
+        const u32 bits[4] = { packed & 0x3ff, packed >> 10 & 0x3ff, packed >> 20 & 0x3ff, packed >> 30 };
+        if constexpr (Format == AttributeFormat::Unorm10_10_10_2) {
+            constexpr f32 scale[4] = { 1.f / 1023.f, 1.f / 1023.f, 1.f / 1023.f, 1.f / 3.f };
+            for (uint32_t i = 0; i < 4; ++i)
+                out[i] = static_cast<f32>(bits[i]) * scale[i];
+        } else {
+            constexpr u32 signBit[4] = { 0x200, 0x200, 0x200, 0x2 };
+            constexpr f32 scale[4] = { 1.f / 511.f, 1.f / 511.f, 1.f / 511.f, 1.f };
+            for (uint32_t i = 0; i < 4; ++i) {
+                const s32 value = static_cast<s32>(bits[i] ^ signBit[i]) - static_cast<s32>(signBit[i]);
+                out[i] = std::max(static_cast<f32>(value) * scale[i], -1.f);
+            }
+        }
+    } else {
+        // zero filled past the attribute so there's no reading past the end of the output for the last vertex
+        uint8_t raw[4 * cComponentSize<Format>] = {};
+        std::memcpy(raw, src, componentCount * cComponentSize<Format>);
+        for (uint32_t i = 0; i < 4; ++i) {
+            if constexpr (Format == AttributeFormat::Unorm8) {
+                out[i] = static_cast<f32>(raw[i]) * (1.f / 255.f);
+            } else if constexpr (Format == AttributeFormat::Snorm8) {
+                out[i] = std::max(static_cast<f32>(static_cast<s8>(raw[i])) * (1.f / 127.f), -1.f);
+            } else {
+                u16 value;
+                std::memcpy(&value, raw + i * 2, sizeof(value));
+                if constexpr (Format == AttributeFormat::Unorm16) {
+                    out[i] = static_cast<f32>(value) * (1.f / 65535.f);
+                } else if constexpr (Format == AttributeFormat::Snorm16) {
+                    out[i] = std::max(static_cast<f32>(static_cast<s16>(value)) * (1.f / 32767.f), -1.f);
+                } else {
+                    f16 half;
+                    std::memcpy(&half, &value, sizeof(half));
+                    out[i] = static_cast<f32>(half);
+                }
+            }
+        }
+    }
+}
+
+template <AttributeFormat Format, AttributeOutput Output>
+static void ConvertAttribute(uint8_t* dst, const uint8_t* src, uint32_t componentCount, uint32_t stride, uint32_t count) {
+    using T = std::conditional_t<Output == AttributeOutput::Float32, f32, f16>;
+    const uint32_t size = componentCount * sizeof(T);
+    for (uint32_t i = 0; i < count; ++i) {
+        f32 values[4];
+        LoadComponents<Format>(src + i * stride, componentCount, values);
+        T converted[4];
+        for (uint32_t j = 0; j < 4; ++j)
+            converted[j] = static_cast<T>(values[j]);
+        std::memcpy(dst + i * size, converted, size);
+    }
+}
+
+template <AttributeOutput Output>
+static void ConvertAttribute(uint8_t* dst, const uint8_t* src, AttributeFormat format, uint32_t componentCount, uint32_t stride, uint32_t count) {
+    switch (format) {
+        case AttributeFormat::Unorm8: return ConvertAttribute<AttributeFormat::Unorm8, Output>(dst, src, componentCount, stride, count);
+        case AttributeFormat::Snorm8: return ConvertAttribute<AttributeFormat::Snorm8, Output>(dst, src, componentCount, stride, count);
+        case AttributeFormat::Unorm16: return ConvertAttribute<AttributeFormat::Unorm16, Output>(dst, src, componentCount, stride, count);
+        case AttributeFormat::Snorm16: return ConvertAttribute<AttributeFormat::Snorm16, Output>(dst, src, componentCount, stride, count);
+        case AttributeFormat::Float16: return ConvertAttribute<AttributeFormat::Float16, Output>(dst, src, componentCount, stride, count);
+        case AttributeFormat::Unorm10_10_10_2: return ConvertAttribute<AttributeFormat::Unorm10_10_10_2, Output>(dst, src, componentCount, stride, count);
+        case AttributeFormat::Snorm10_10_10_2: return ConvertAttribute<AttributeFormat::Snorm10_10_10_2, Output>(dst, src, componentCount, stride, count);
+    }
+}
+
+bool MeshTableSink::OnMeshBlock(const MeshBlockOutput& block) {
+    mTable.meshes.push_back({
+        .indexOffset = static_cast<uint64_t>(block.indices + block.indexOffset - mOutput),
+        .indexSize = block.indexSize,
+        .indexStride = block.indexStride,
+        .indexCount = block.indexCount,
+        .vertexOffset = static_cast<uint64_t>(block.vertices + block.vertexOffset - mOutput),
+        .vertexSize = block.vertexSize,
+        .vertexCount = block.vertexCount,
+        .firstVertexBuffer = static_cast<uint32_t>(mTable.vertexBuffers.size()),
+        .vertexBufferCount = block.vertexBufferCount,
+        .firstAttribute = static_cast<uint32_t>(mTable.attributes.size()),
+        .attributeCount = block.attributeCount,
+    });
+    mTable.vertexBuffers.insert(mTable.vertexBuffers.end(), block.vertexBuffers, block.vertexBuffers + block.vertexBufferCount);
+    mTable.attributes.insert(mTable.attributes.end(), block.attributes, block.attributes + block.attributeCount);
+    return true;
+}
+
+bool ScatterMeshSink::CopyVertexBuffers(const MeshBlockOutput& block) {
+    for (uint32_t i = 0; i < block.vertexBufferCount; ++i) {
+        const VertexBufferInfo& info = block.vertexBuffers[i];
+        if (info.size == 0)
+            continue;
+
+        void* vertices = mAllocator.AllocateVertexBuffer(block.mesh, i, info);
+        if (vertices == nullptr)
+            return false;
+        std::memcpy(vertices, block.vertices + block.vertexOffset + info.offset, info.size);
+    }
+
+    return true;
+}
+
+bool ScatterMeshSink::CopyAttributes(const MeshBlockOutput& block) {
+    for (uint32_t i = 0; i < block.attributeCount; ++i) {
+        const VertexAttributeInfo& info = block.attributes[i];
+        if (info.size == 0 || block.vertexCount == 0)
+            continue;
+
+        AttributeConversion conversion = mAllocator.GetAttributeConversion(block.mesh, i, info);
+        if (info.bitOffset != 0)
+            conversion.output = AttributeOutput::Copy;
+        const uint32_t componentCount = std::min(info.componentCount, 4u);
+        const uint32_t elementSize = conversion.output == AttributeOutput::Float32 ? componentCount * 4
+                                   : conversion.output == AttributeOutput::Float16 ? componentCount * 2 : info.size;
+
+        void* attribute = mAllocator.AllocateAttributeArray(block.mesh, i, info, elementSize, block.vertexCount);
+        if (attribute == nullptr)
+            return false;
+
+        uint8_t* dst = reinterpret_cast<uint8_t*>(attribute);
+        const uint8_t* src = block.vertices + block.vertexOffset + info.offset;
+        switch (conversion.output) {
+            case AttributeOutput::Copy:
+                CopyAttribute(dst, src, info.size, info.stride, block.vertexCount);
+                break;
+            case AttributeOutput::Float32:
+                ConvertAttribute<AttributeOutput::Float32>(dst, src, conversion.format, componentCount, info.stride, block.vertexCount);
+                break;
+            case AttributeOutput::Float16:
+                ConvertAttribute<AttributeOutput::Float16>(dst, src, conversion.format, componentCount, info.stride, block.vertexCount);
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool ScatterMeshSink::OnMeshBlock(const MeshBlockOutput& block) {
+    if (block.indexSize != 0) {
+        void* indices = mAllocator.AllocateIndexBuffer(block.mesh, block.indexSize);
+        if (indices == nullptr) {
+            mFailed = true;
+            return false;
+        }
+        std::memcpy(indices, block.indices + block.indexOffset, block.indexSize);
+    }
+
+    const bool copied = mLayout == VertexLayout::Interleaved ? CopyVertexBuffers(block) : CopyAttributes(block);
+    mFailed = !copied;
+    return copied;
+}
+
+} // namespace mc
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace mc {
+
+// one of a mesh's vertex buffers, the offset is from the start of the mesh's vertices
+struct VertexBufferInfo {
+    uint32_t offset;
+    uint32_t size;      // stride * vertex count, plus padding up to the stream's vertex alignment
+    uint32_t stride;
+};
+
+// one of a mesh's vertex attributes as the codec writes it
+struct VertexAttributeInfo {
+    uint32_t offset;            // from the start of the mesh's vertices to the attribute of the first vertex
+    uint32_t stride;            // of the vertex buffer it's in
+    uint32_t size;              // bytes per vertex, rounded up to whole bytes (so bit packed attributes come with whatever shares those bytes)
+    uint32_t componentCount;
+    uint32_t componentBits;
+    uint32_t bitOffset;         // where the attribute starts in its first byte
+};
+
+// one mesh's part of the index and vertex buffers, offsets are from the start of each buffer
+// the vertex buffers of a mesh are back to back so they're also a single range
+struct MeshBlockOutput {
+    static constexpr uint32_t cMaxVertexBuffers = 15;
+    static constexpr uint32_t cMaxAttributes = 15;
+
+    uint32_t mesh;              // position in the stream
+    const uint8_t* indices;
+    uint32_t indexOffset;
+    uint32_t indexSize;
+    uint32_t indexStride;       // 2 or 4, 0 if the mesh has no indices
+    uint32_t indexCount;
+    const uint8_t* vertices;
+    uint32_t vertexOffset;
+    uint32_t vertexSize;
+    uint32_t vertexCount;
+    uint32_t vertexBufferCount;
+    VertexBufferInfo vertexBuffers[cMaxVertexBuffers];
+    uint32_t attributeCount;
+    VertexAttributeInfo attributes[cMaxAttributes];
+};
+
+// gets handed every mesh as soon as the codec is done writing it, so uploading/compressing/writing it out can start while the rest of the
+// stream is still being decoded (see DecodeOptions::meshSink)
+// called on the decoding thread (the FMSH thread with DecodeOptions::concurrentFMSH), in stream order
+class MeshSink {
+public:
+    virtual ~MeshSink() = default;
+
+    // the ranges don't change anymore but later meshes may still read from them, so they have to stay in place until the decode returns
+    // returning false stops the stream right there, same as hitting DecodeOptions::maxMeshes (the stream still succeeds)
+    virtual bool OnMeshBlock(const MeshBlockOutput& block) = 0;
+};
+
+// every mesh of a decoded stream with its offsets in the output buffer, so typed views over the output can be made without parsing the
+// bfres again, it stays valid for as long as the output does (and can be saved along with it)
+struct MeshTable {
+    struct Mesh {
+        uint64_t indexOffset;       // from the start of the output
+        uint32_t indexSize;
+        uint32_t indexStride;       // 2 or 4, 0 if the mesh has no indices
+        uint32_t indexCount;
+        uint64_t vertexOffset;      // from the start of the output, the buffer and attribute offsets are from here
+        uint32_t vertexSize;
+        uint32_t vertexCount;
+        uint32_t firstVertexBuffer; // in vertexBuffers
+        uint32_t vertexBufferCount;
+        uint32_t firstAttribute;    // in attributes
+        uint32_t attributeCount;
+    };
+
+    std::vector<Mesh> meshes;
+    std::vector<VertexBufferInfo> vertexBuffers;
+    std::vector<VertexAttributeInfo> attributes;
+
+    std::span<const VertexBufferInfo> GetVertexBuffers(uint32_t mesh) const {
+        return { vertexBuffers.data() + meshes[mesh].firstVertexBuffer, meshes[mesh].vertexBufferCount };
+    }
+    std::span<const VertexAttributeInfo> GetAttributes(uint32_t mesh) const {
+        return { attributes.data() + meshes[mesh].firstAttribute, meshes[mesh].attributeCount };
+    }
+
+    // T has to match the mesh's index stride (uint16_t or uint32_t)
+    template <typename T>
+    std::span<const T> GetIndices(const void* output, uint32_t mesh) const {
+        const Mesh& info = meshes[mesh];
+        if (info.indexStride != sizeof(T))
+            return {};
+        return { reinterpret_cast<const T*>(static_cast<const uint8_t*>(output) + info.indexOffset), info.indexCount };
+    }
+    std::span<const uint8_t> GetVertexBuffer(const void* output, uint32_t mesh, uint32_t buffer) const {
+        const VertexBufferInfo& info = vertexBuffers[meshes[mesh].firstVertexBuffer + buffer];
+        return { static_cast<const uint8_t*>(output) + meshes[mesh].vertexOffset + info.offset, info.size };
+    }
+
+    void Clear() {
+        meshes.clear();
+        vertexBuffers.clear();
+        attributes.clear();
+    }
+};
+
+// fills a MeshTable while decoding into output (the dst passed to the decode function)
+class MeshTableSink final : public MeshSink {
+public:
+    MeshTableSink(MeshTable& table, const void* output) : mTable(table), mOutput(static_cast<const uint8_t*>(output)) {}
+
+    bool OnMeshBlock(const MeshBlockOutput& block) override;
+
+    // for decoding another stream into the same table (e.g. with DecoderSession), the meshes get added after the ones already in there
+    void SetOutput(const void* output) {
+        mOutput = static_cast<const uint8_t*>(output);
+    }
+
+private:
+    MeshTable& mTable;
+    const uint8_t* mOutput;
+};
+
+// how ScatterMeshSink lays out the vertices of each mesh
+enum class VertexLayout {
+    Interleaved,    // each vertex buffer as is
+    Separate,       // one tightly packed array per attribute (size bytes per vertex, unless it gets converted)
+};
+
+// what an attribute holds, the codec only knows its bit layout so this has to come from the mesh's vertex format (e.g. the bfres)
+enum class AttributeFormat {
+    Unorm8,
+    Snorm8,
+    Unorm16,
+    Snorm16,
+    Float16,
+    Unorm10_10_10_2,    // the components are always read from a whole 32 bit value
+    Snorm10_10_10_2,
+};
+
+enum class AttributeOutput {
+    Copy,       // as decoded
+    Float32,
+    Float16,
+};
+
+// converts an attribute while it's being split out with VertexLayout::Separate, so there's no second pass over the arrays afterwards
+// componentCount components per vertex (at most 4), the 2 bit w of the 10:10:10:2 formats is the fourth one
+// attributes that don't start on a byte boundary are always copied
+struct AttributeConversion {
+    AttributeOutput output = AttributeOutput::Copy;
+    AttributeFormat format = AttributeFormat::Unorm8;
+};
+
+// where ScatterMeshSink puts each mesh, e.g. pooled gpu staging memory
+// return nullptr to stop the stream, empty index streams and vertex buffers aren't allocated
+class MeshBufferAllocator {
+public:
+    virtual ~MeshBufferAllocator() = default;
+
+    virtual void* AllocateIndexBuffer(uint32_t mesh, uint32_t size) = 0;
+    // for VertexLayout::Interleaved
+    virtual void* AllocateVertexBuffer(uint32_t mesh [[maybe_unused]], uint32_t buffer [[maybe_unused]], const VertexBufferInfo& info [[maybe_unused]]) {
+        return nullptr;
+    }
+    // for VertexLayout::Separate, elementSize * vertexCount bytes (info.size unless the attribute gets converted)
+    virtual void* AllocateAttributeArray(uint32_t mesh [[maybe_unused]], uint32_t attribute [[maybe_unused]], const VertexAttributeInfo& info [[maybe_unused]],
+                                         uint32_t elementSize [[maybe_unused]], uint32_t vertexCount [[maybe_unused]]) {
+        return nullptr;
+    }
+    // for VertexLayout::Separate, asked right before each attribute array gets allocated
+    virtual AttributeConversion GetAttributeConversion(uint32_t mesh [[maybe_unused]], uint32_t attribute [[maybe_unused]],
+                                                       const VertexAttributeInfo& info [[maybe_unused]]) {
+        return {};
+    }
+};
+
+// splits every mesh into its index stream and each of its vertex buffers (or attributes) and moves them into memory from a
+// MeshBufferAllocator right as the mesh is done, while it's still in cache
+// the codec itself still needs the whole contiguous output since later meshes reference earlier ones (the raw vertex streams use all of
+// the vertex output decoded so far as their zstd window) and the index size of a mesh is only known once its last index stream is read,
+// but the output can be a single staging buffer that gets reused for every file (e.g. with DecoderSession)
+// the same goes for separate attribute arrays, the vertex streams reference earlier vertices by their offset in the interleaved output
+class ScatterMeshSink final : public MeshSink {
+public:
+    explicit ScatterMeshSink(MeshBufferAllocator& allocator, VertexLayout layout = VertexLayout::Interleaved) : mAllocator(allocator), mLayout(layout) {}
+
+    bool OnMeshBlock(const MeshBlockOutput& block) override;
+
+    // whether an allocation failed and stopped the last stream (the decode itself still reports success)
+    bool HasFailed() const {
+        return mFailed;
+    }
+    void Reset() {
+        mFailed = false;
+    }
+
+private:
+    bool CopyVertexBuffers(const MeshBlockOutput& block);
+    bool CopyAttributes(const MeshBlockOutput& block);
+
+    MeshBufferAllocator& mAllocator;
+    VertexLayout mLayout;
+    bool mFailed = false;
+};
+
+} // namespace mc
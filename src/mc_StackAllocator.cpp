@@ -6,7 +6,7 @@
 #include "mc_IndexCodec.h"
 
 #include <algorithm> // std::max
-#include <cstdlib> // exit
+#include <cstdlib> // exit, std::malloc, std::free
 
 #ifndef NDEBUG
 #include <iostream>
@@ -31,8 +31,11 @@ void* StackAllocator::Alloc(size_t size, s64 alignment) {
     
     u64 start = (alignment + mMemoryOffset + 7) & -alignment;
     u64 end = start + size;
-    if (end > mMemorySize)
-        detail::ExitWithDetail(__FILE__, __LINE__); // yes Nintendo does this for some reason
+    if (end > mMemorySize) {
+        if (mOverflowPolicy == OverflowPolicy::Exit)
+            detail::ExitWithDetail(__FILE__, __LINE__); // yes Nintendo does this for some reason
+        return Spill(size, alignment, true);
+    }
     
     void* ptr = reinterpret_cast<void*>(mMemory + start);
     reinterpret_cast<MemBlock*>(ptr)->GetBlockInfo()->data = (start - mLastAllocationStart) | (start - mMemoryOffset) << 0x1f;
@@ -46,6 +49,11 @@ void* StackAllocator::Alloc(size_t size, s64 alignment) {
 void StackAllocator::Free(void* ptr) {
     if (ptr == nullptr)
         return;
+
+    if (mSpillList != nullptr && IsSpilled(ptr)) {
+        FreeSpilled(ptr);
+        return;
+    }
     
     MemBlock* block = reinterpret_cast<MemBlock*>(ptr);
     size_t startOffset = mLastAllocationStart;
@@ -74,6 +82,55 @@ void StackAllocator::Free(void* ptr) {
     }
 }
 
+// allocations that don't fit are handed out from the heap instead, each one has a SpillBlock in front of it (linked so they can all be
+// freed at once if the stream doesn't free them itself) and a pointer to it right before the returned address where a BlockInfo would be
+void* StackAllocator::Spill(size_t size, s64 alignment, bool overflow) {
+    const size_t blockSize = sizeof(SpillBlock) + sizeof(SpillBlock*) + alignment + size;
+    u8* raw = reinterpret_cast<u8*>(std::malloc(blockSize));
+    if (raw == nullptr)
+        detail::ExitWithDetail(__FILE__, __LINE__); // nowhere left to get the memory from and the codec can't handle a null pointer
+
+    SpillBlock* block = reinterpret_cast<SpillBlock*>(raw);
+    block->prev = nullptr;
+    block->next = mSpillList;
+    block->size = overflow ? blockSize : 0;
+    if (mSpillList != nullptr)
+        mSpillList->prev = block;
+    mSpillList = block;
+
+    u8* ptr = reinterpret_cast<u8*>((reinterpret_cast<uintptr_t>(raw) + sizeof(SpillBlock) + sizeof(SpillBlock*) + alignment - 1) & -alignment);
+    reinterpret_cast<SpillBlock**>(ptr)[-1] = block;
+
+    mSpilledSize += block->size;
+    mPeakSpilledSize = std::max(mPeakSpilledSize, mSpilledSize);
+    if (overflow && mOverflowPolicy == OverflowPolicy::Fail)
+        mOutOfMemory = true;
+
+    return ptr;
+}
+
+void StackAllocator::FreeSpilled(void* ptr) {
+    SpillBlock* block = reinterpret_cast<SpillBlock**>(ptr)[-1];
+    if (block->prev != nullptr)
+        block->prev->next = block->next;
+    else
+        mSpillList = block->next;
+    if (block->next != nullptr)
+        block->next->prev = block->prev;
+
+    mSpilledSize -= block->size;
+    std::free(block);
+}
+
+void StackAllocator::ReleaseOverflow() {
+    while (mSpillList != nullptr) {
+        SpillBlock* next = mSpillList->next;
+        std::free(mSpillList);
+        mSpillList = next;
+    }
+    mSpilledSize = 0;
+}
+
 s32 StackAllocator::DecompressFrame(const u8* data, size_t size) {
     u32 bitStreamOffset0 = mStreamOffset;
     u32 bitStreamOffset1 = mFrameEndOffset;
@@ -94,9 +151,39 @@ s32 StackAllocator::DecompressFrame(const u8* data, size_t size) {
 
     mCodec->Decompress(ctx);
 
+    return FinishFrame();
+}
+
+s32 StackAllocator::ResumeFrame(const u8* data, const FrameCursor& cursor) {
+    if (mCodecType != CodecType::MeshCodec)
+        return static_cast<s32>(InvalidCodec);
+
+    // the sizes of the next frame, the bit streams of this one are picked up from the cursor instead
+    const u8* ptr = data;
+    mStreamOffset = meshopt::decodeVByteReversed(ptr);
+    mFrameEndOffset = meshopt::decodeVByteReversed(ptr);
+
+    DecompContext ctx;
+    cursor.Restore(ctx, data);
+
+    static_cast<MeshCodec*>(mCodec)->Resume(ctx, cursor.blocksRemaining);
+
+    return FinishFrame();
+}
+
+s32 StackAllocator::FinishFrame() {
+    // the codec can't back out partway through a frame so this is the earliest point the stream can be stopped
+    if (mOutOfMemory) {
+        ReleaseOverflow();
+        detail::SetFPUState(mPreviousFPUState);
+        return static_cast<s32>(OutOfMemory);
+    }
+
     if (mFrameEndOffset + mStreamOffset != 0)
         return mFrameEndOffset + mStreamOffset;
     
+    // nothing needs the spilled memory once the last frame is done
+    ReleaseOverflow();
     detail::SetFPUState(mPreviousFPUState);
 
     return 0;
@@ -125,13 +212,20 @@ inline bool UnkValueIsValid(u32 value) {
 s32 InitializeStackAllocator(StackAllocator** outPtr, const CompressionFlags& flags, const StackAllocator::InitArg& initArg, const ResFrameSize* sizes, u64 type) {
     if (type != 6)
         return static_cast<s32>(SizeMismatch);
+    if (initArg.workMemorySize < sizeof(StackAllocator))
+        return static_cast<s32>(Error8);
     
     StackAllocator* allocator = std::construct_at(reinterpret_cast<StackAllocator*>(initArg.workMemory),
                                                   reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(initArg.workMemory) + sizeof(StackAllocator)),
                                                   initArg.workMemorySize - sizeof(StackAllocator), 0x40);
+    allocator->SetOverflowPolicy(initArg.overflowPolicy);
     CodecBase* codec = detail::CreateCodec(flags.codec, allocator);
     codec->Initialize(initArg.indexStream, initArg.vertexStream, flags._04, allocator);
+    codec->SetAttributeMask(initArg.attributeMask);
+    codec->SetAttributePool(initArg.attributePool);
     allocator->SetCodec(codec);
+    allocator->SetCodecType(flags.codec);
+    allocator->SetBaseMarker(allocator->GetMarker());
 
     u32 streamOffset = sizes->streamOffset.get();
     u32 endOffset = sizes->endOffset.get();
@@ -162,6 +256,39 @@ s32 CreateStackAllocator(StackAllocator** outPtr, const StackAllocator::InitArg&
     }
 }
 
+s32 ResetStackAllocator(StackAllocator* allocator, const StackAllocator::InitArg& initArg, const ResCompressionHeader* res) {
+    CompressionFlags flags{
+        res->GetCodecType(),
+        static_cast<u32>(res->flags >> 2),
+    };
+    if (flags.codec == CodecType::Invalid || flags.codec != allocator->GetCodecType())
+        return static_cast<s32>(InvalidCodec);
+    if (!detail::UnkValueIsValid(flags._04))
+        return static_cast<s32>(Error8);
+
+    // the codec itself spilled onto the heap and that memory is gone by now (see ReleaseOverflow), so it has to be set up from scratch
+    if (allocator->GetBaseMarker().spilledSize != 0) {
+        allocator->ReleaseOverflow();
+        return InitializeStackAllocator(&allocator, flags, initArg, &res->sizeInfo, 6);
+    }
+
+    allocator->SetOverflowPolicy(initArg.overflowPolicy);
+
+    // anything left over from a stream that failed partway through gets dropped here
+    allocator->Rewind(allocator->GetBaseMarker());
+    allocator->GetCodec()->Reset(initArg.indexStream, initArg.vertexStream);
+    allocator->GetCodec()->SetAttributeMask(initArg.attributeMask);
+    allocator->GetCodec()->SetAttributePool(initArg.attributePool);
+
+    u32 streamOffset = res->sizeInfo.streamOffset.get();
+    u32 endOffset = res->sizeInfo.endOffset.get();
+
+    allocator->SetFPUState(detail::InitFPUState());
+    allocator->SetStreamSizes(streamOffset, endOffset);
+
+    return streamOffset + endOffset;
+}
+
 u32 ConvertResult(u64 raw) {
     if (raw >> 0x1f) {
         if (raw == SizeMismatch)
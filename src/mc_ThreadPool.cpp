@@ -0,0 +1,84 @@
+#include "mc_ThreadPool.h"
+
+#include <algorithm> // std::max
+
+namespace mc {
+
+ThreadPool::ThreadPool(u32 threadCount) {
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    mQueues = std::make_unique<WorkerQueue[]>(threadCount);
+    mWorkers.reserve(threadCount);
+    for (u32 i = 0; i < threadCount; ++i)
+        mWorkers.emplace_back(&ThreadPool::WorkerMain, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mMutex);
+        mStop = true;
+    }
+    mWorkAvailable.notify_all();
+    for (std::thread& worker : mWorkers)
+        worker.join();
+}
+
+void ThreadPool::Submit(Task task) {
+    const u32 queueIndex = mNextQueue.fetch_add(1, std::memory_order_relaxed) % GetThreadCount();
+    {
+        std::lock_guard lock(mQueues[queueIndex].mutex);
+        mQueues[queueIndex].tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(mMutex);
+        ++mQueuedTasks;
+        ++mPendingTasks;
+    }
+    mWorkAvailable.notify_one();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock lock(mMutex);
+    mWorkFinished.wait(lock, [this] { return mPendingTasks == 0; });
+}
+
+bool ThreadPool::TryPop(u32 workerIndex, Task& task) {
+    const u32 threadCount = GetThreadCount();
+    // own queue first, then everyone else's starting from the next worker
+    for (u32 i = 0; i < threadCount; ++i) {
+        WorkerQueue& queue = mQueues[(workerIndex + i) % threadCount];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerMain(u32 workerIndex) {
+    while (true) {
+        {
+            std::unique_lock lock(mMutex);
+            mWorkAvailable.wait(lock, [this] { return mQueuedTasks != 0 || mStop; });
+            if (mQueuedTasks == 0)
+                return;
+            --mQueuedTasks; // claims a task, one of the queues is guaranteed to have it
+        }
+
+        Task task;
+        while (!TryPop(workerIndex, task)) {
+            // another worker took the task from a queue after we had already scanned past it, there's still one left for us
+            std::this_thread::yield();
+        }
+        task(workerIndex);
+
+        std::lock_guard lock(mMutex);
+        if (--mPendingTasks == 0)
+            mWorkFinished.notify_all();
+    }
+}
+
+} // namespace mc
@@ -1,6 +1,9 @@
 #include "mc_VertexCodec.h"
 
 #include <algorithm> // std::min
+#include <atomic>
+#include <cstring> // std::memcpy
+#include <memory> // std::unique_ptr
 
 /**
  * meshoptimizer - version 0.22
@@ -397,6 +400,137 @@ void GenDecodingTable1(void* dst, DecompContext& ctx, s32 count0, s32 maxIndexBi
     ctx.bitStream0.SetRemainder(remainder);
 }
 
+void BuildMultiSymbolTable(u64* dst, const u32* tbl, u32 bitSize) {
+    const u32 mask = (1u << bitSize) - 1;
+    for (u32 i = 0; i <= mask; ++i) {
+        // each code is followed by the next one in the bits of the index that are left
+        u64 entry = 0;
+        u32 used = 0;
+        for (u32 j = 0; j < cMaxTableSymbols; ++j) {
+            const u32 value = tbl[(i << used) & mask];
+            entry |= static_cast<u64>(value & 0xffff) << (j * 0x10);
+            used += value >> 0x10;
+        }
+        dst[i] = entry | static_cast<u64>(used) << 0x30;
+    }
+}
+
+static constexpr u32 cCachedTableCount = 8;
+static constexpr u32 cMaxCachedDescriptorBits = 0x1000;
+static constexpr u32 cMaxCachedIndexBitSize = 11;
+
+struct CachedDecodingTable {
+    u32 key; // encoding, index bit size + symbol count (everything the descriptor bits are read with)
+    u32 descriptorBits; // 0 = empty
+    u32 descriptor[cMaxCachedDescriptorBits / 0x20];
+    u16 table[0x1800]; // only the parts the decode functions read are filled in
+};
+
+struct DecodingTableCache {
+    CachedDecodingTable tables[cCachedTableCount];
+    u32 next; // replaced in the order they were added
+};
+
+static thread_local std::unique_ptr<DecodingTableCache> sDecodingTableCache;
+static std::atomic<u64> sDecodingTableCacheHits = 0;
+static std::atomic<u64> sDecodingTableCacheMisses = 0;
+
+DecodingTableCacheStats GetDecodingTableCacheStats() {
+    return { sDecodingTableCacheHits.load(std::memory_order_relaxed), sDecodingTableCacheMisses.load(std::memory_order_relaxed) };
+}
+
+void ResetDecodingTableCacheStats() {
+    sDecodingTableCacheHits.store(0, std::memory_order_relaxed);
+    sDecodingTableCacheMisses.store(0, std::memory_order_relaxed);
+}
+
+// the position in the stream in bits, goes down as it's read
+static s64 GetBitPosition(const BitStreamReader& stream) {
+    return static_cast<s64>(reinterpret_cast<uintptr_t>(stream.GetStream())) * 8 + stream.GetBitOffset();
+}
+
+// the next count bits 32 at a time without moving the stream (the last one is in the top bits)
+static void PeekBits(BitStreamReader stream, u32* dst, u32 count) {
+    for (; count >= 0x20; count -= 0x20)
+        *dst++ = static_cast<u32>(stream.Read(0x20));
+    if (count != 0)
+        *dst = static_cast<u32>(stream.Read(count)) << (0x20 - count);
+}
+
+static void SkipBits(BitStreamReader& stream, u32 count) {
+    for (; count >= 0x20; count -= 0x20)
+        stream.Read(0x20);
+    if (count != 0)
+        stream.Read(count);
+}
+
+// u32 entries for both encodings, _00 also has a u16 value per entry at 0x1000
+static void CopyDecodingTable(u16* dst, const u16* src, ByteStreamEncoding encoding, u32 maxIndexBitSize) {
+    std::memcpy(dst, src, sizeof(u32) << maxIndexBitSize);
+    if (encoding == ByteStreamEncoding::_00)
+        std::memcpy(dst + 0x1000, src + 0x1000, sizeof(u16) << maxIndexBitSize);
+}
+
+// 32 bits at a time so a mismatch doesn't read any further into the stream than it has to
+static bool MatchesDescriptor(const CachedDecodingTable& table, BitStreamReader stream) {
+    u32 count = table.descriptorBits;
+    const u32* descriptor = table.descriptor;
+    for (; count >= 0x20; count -= 0x20) {
+        if (static_cast<u32>(stream.Read(0x20)) != *descriptor++)
+            return false;
+    }
+    return count == 0 || static_cast<u32>(stream.Read(count)) << (0x20 - count) == *descriptor;
+}
+
+static void BuildDecodingTable(DecodingContext* decodeCtx, DecompContext& decompCtx, u32 bitCount) {
+    if (decodeCtx->encoding == ByteStreamEncoding::_00) {
+        GenDecodingTable0(decodeCtx->decodingTable, bitCount, decodeCtx->maxIndexBitSize, decompCtx);
+    } else {
+        GenDecodingTable1(decodeCtx->decodingTable, decompCtx, bitCount, decodeCtx->maxIndexBitSize);
+    }
+}
+
+// reading the descriptor never depends on bits past the ones it takes, so the same bits coming up in the stream always mean the same table
+// and the same number of bits read (its length is only known once it has been read though, so the cached ones get compared against the
+// stream instead of looked up by a hash of it)
+static void BuildDecodingTableCached(DecodingContext* decodeCtx, DecompContext& decompCtx, u32 bitCount) {
+    if (sDecodingTableCache == nullptr)
+        sDecodingTableCache = std::make_unique<DecodingTableCache>();
+    DecodingTableCache& cache = *sDecodingTableCache;
+
+    const u32 key = static_cast<u32>(decodeCtx->encoding) | decodeCtx->maxIndexBitSize << 1 | bitCount << 5;
+    BitStreamReader& stream = decompCtx.bitStream0;
+    // the bit stream is read backwards towards the byte stream, and each read loads the 8 bytes below where it's at, so a cached descriptor
+    // only gets compared if all of it fits in front of the byte stream (the input may end right before it)
+    const s64 bitsLeft = GetBitPosition(stream) - 0x40 - static_cast<s64>(reinterpret_cast<uintptr_t>(decompCtx.currentPos)) * 8;
+    for (const CachedDecodingTable& table : cache.tables) {
+        if (table.descriptorBits == 0 || table.key != key || table.descriptorBits > bitsLeft)
+            continue;
+        if (!MatchesDescriptor(table, stream))
+            continue;
+
+        CopyDecodingTable(decodeCtx->decodingTable, table.table, decodeCtx->encoding, decodeCtx->maxIndexBitSize);
+        SkipBits(stream, table.descriptorBits);
+        sDecodingTableCacheHits.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const BitStreamReader start = stream;
+    BuildDecodingTable(decodeCtx, decompCtx, bitCount);
+    sDecodingTableCacheMisses.fetch_add(1, std::memory_order_relaxed);
+
+    const s64 descriptorBits = GetBitPosition(start) - GetBitPosition(stream);
+    if (descriptorBits <= 0 || descriptorBits > cMaxCachedDescriptorBits || descriptorBits > bitsLeft) // same for copying it out again
+        return;
+
+    CachedDecodingTable& table = cache.tables[cache.next];
+    cache.next = (cache.next + 1) % cCachedTableCount;
+    table.key = key;
+    table.descriptorBits = static_cast<u32>(descriptorBits);
+    PeekBits(start, table.descriptor, table.descriptorBits);
+    CopyDecodingTable(table.table, decodeCtx->decodingTable, decodeCtx->encoding, decodeCtx->maxIndexBitSize);
+}
+
 void GenDecodingTable(DecodingContext* decodeCtx, DecompContext& decompCtx) {
     u64 remainder = decompCtx.bitStream0.GetRemainder();
     u32 bitOffset = decompCtx.bitStream0.GetBitOffset() | 0x38;
@@ -453,11 +587,10 @@ void GenDecodingTable(DecodingContext* decodeCtx, DecompContext& decompCtx) {
     decompCtx.bitStream0.SetBitOffset(bitOffset - 5);
     decompCtx.bitStream0.SetRemainder(remainder << 5);
 
-    if (decodeCtx->encoding == ByteStreamEncoding::_00) {
-        GenDecodingTable0(decodeCtx->decodingTable, bitCount, decodeCtx->maxIndexBitSize, decompCtx);
-    } else {
-        GenDecodingTable1(decodeCtx->decodingTable, decompCtx, bitCount, decodeCtx->maxIndexBitSize);
-    }
+    if (sDecodingTableCacheEnabled && decodeCtx->maxIndexBitSize <= cMaxCachedIndexBitSize)
+        BuildDecodingTableCached(decodeCtx, decompCtx, bitCount);
+    else
+        BuildDecodingTable(decodeCtx, decompCtx, bitCount);
 }
 
 } // namespace mc
\ No newline at end of file
@@ -196,7 +196,16 @@ void ReadVertexInfoTableBlock(VertexDecodingStreamSet& streams, VertexDecodingSt
     }
 }
 
-void DecodeVertexInfoTable(u32* tbl, s32 numVertices, VertexDecodingStreamSet& inputStreams, VertexDecodingStreamSizes& inputStreamSizes, u32 a5 [[maybe_unused]], VertexInfoTableInfo& a6, s32 baseVertex) {
+// codepoints past 0xf take the rest of the count from the bit stream, which has to have been refilled for it
+// (only refilled when something is read since the stream can be empty)
+static MC_FORCE_INLINE u32 DecodeGroupCount(u8 codepoint, ForwardBitStreamReader& reader) {
+    if (codepoint <= 0xf)
+        return codepoint;
+    return cVertexGroupEncodingTable[codepoint - 0x10][1] + static_cast<u32>(reader.Take(cVertexGroupEncodingTable[codepoint - 0x10][0])) + 0x10;
+}
+
+// the two bit stream reads of an entry are at most 28 bits each so they share a refill
+static MC_FORCE_INLINE void DecodeVertexInfoTableImpl(u32* tbl, s32 numVertices, VertexDecodingStreamSet& inputStreams, VertexDecodingStreamSizes& inputStreamSizes, VertexInfoTableInfo& a6, s32 baseVertex) {
     u32 backRefOffsetCount = inputStreamSizes.backrefOffsetStreamSize;
     if (backRefOffsetCount == 0) {
         if (numVertices != 0) {
@@ -211,20 +220,17 @@ void DecodeVertexInfoTable(u32* tbl, s32 numVertices, VertexDecodingStreamSet& i
             u8* vertexCountStream = inputStreams.vertexCountStream;
             u8* indexStream = inputStreams.backrefCountStream;
             u8* fifoIndexStream = inputStreams.backrefOffsetStream;
-            BitStreamReader reader(reinterpret_cast<u64*>(inputStreams.bitStream), BitStreamReader::Direction::Forwards);
+            ForwardBitStreamReader reader(reinterpret_cast<u64*>(inputStreams.bitStream));
             s32 lastIndex = -1;
             u32 mask = a6._0c;
 
             for (u32 i = backRefOffsetCount; i != 0; --i) {
-                u8 codepoint = *indexStream++;
-                s32 index = static_cast<s32>(codepoint);
-                if (codepoint > 0xf)
-                    index = cVertexGroupEncodingTable[codepoint - 0x10][1] + reader.ReadForwards(cVertexGroupEncodingTable[codepoint - 0x10][0]) + 0x10;
-                
-                codepoint = *fifoIndexStream++;
-                s32 packedValue = static_cast<s32>(codepoint);
-                if (codepoint > 0xf)
-                    packedValue = cVertexGroupEncodingTable[codepoint - 0x10][1] + reader.ReadForwards(cVertexGroupEncodingTable[codepoint - 0x10][0]) + 0x10;
+                const u8 indexCodepoint = *indexStream++;
+                const u8 fifoCodepoint = *fifoIndexStream++;
+                if ((indexCodepoint | fifoCodepoint) > 0xf)
+                    reader.Refill();
+                s32 index = static_cast<s32>(DecodeGroupCount(indexCodepoint, reader));
+                s32 packedValue = static_cast<s32>(DecodeGroupCount(fifoCodepoint, reader));
 
                 index += lastIndex;
                 lastIndex = index;
@@ -272,7 +278,26 @@ void DecodeVertexInfoTable(u32* tbl, s32 numVertices, VertexDecodingStreamSet& i
     }
 }
 
-u32 Parse(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputStreams, BitStreamReader& bitStream, u32 stride, u32 a6, u32 format, u32 totalVertexCount) {
+static void DecodeVertexInfoTableGeneric(u32* tbl, s32 numVertices, VertexDecodingStreamSet& inputStreams, VertexDecodingStreamSizes& inputStreamSizes, VertexInfoTableInfo& a6, s32 baseVertex) {
+    DecodeVertexInfoTableImpl(tbl, numVertices, inputStreams, inputStreamSizes, a6, baseVertex);
+}
+
+#ifdef MC_X86_DISPATCH
+MC_TARGET_BMI2 static void DecodeVertexInfoTableBMI2(u32* tbl, s32 numVertices, VertexDecodingStreamSet& inputStreams, VertexDecodingStreamSizes& inputStreamSizes, VertexInfoTableInfo& a6, s32 baseVertex) {
+    DecodeVertexInfoTableImpl(tbl, numVertices, inputStreams, inputStreamSizes, a6, baseVertex);
+}
+#endif
+
+void DecodeVertexInfoTable(u32* tbl, s32 numVertices, VertexDecodingStreamSet& inputStreams, VertexDecodingStreamSizes& inputStreamSizes, u32 a5 [[maybe_unused]], VertexInfoTableInfo& a6, s32 baseVertex) {
+#ifdef MC_X86_DISPATCH
+    if (HasBMI2())
+        return DecodeVertexInfoTableBMI2(tbl, numVertices, inputStreams, inputStreamSizes, a6, baseVertex);
+#endif
+    DecodeVertexInfoTableGeneric(tbl, numVertices, inputStreams, inputStreamSizes, a6, baseVertex);
+}
+
+// one refill for the two counts of a group (at most 28 bits each) and one for the backref offset (at most 31)
+static MC_FORCE_INLINE u32 ParseImpl(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputStreams, ForwardBitStreamReader& bitStream, u32 stride, u32 a6, u32 format, u32 totalVertexCount) {
     u8* vertexCountStream = inputStreams.vertexCountStream;
     u8* backrefCountStream = inputStreams.backrefCountStream;
     u16* backrefOffsetStream = reinterpret_cast<u16*>(inputStreams.backrefOffsetStream);
@@ -284,23 +309,20 @@ u32 Parse(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputSt
     if (count > 1) {
         u32 advanceIndex = 0;
         for (u32 i = count; i > 1; --i) {
-            u8 codepoint = *vertexCountStream++;
-            u32 vertCount = static_cast<u32>(codepoint);
-            if (codepoint > 0xf)
-                vertCount = cVertexGroupEncodingTable[codepoint - 0x10][1] + bitStream.ReadForwards(cVertexGroupEncodingTable[codepoint - 0x10][0]) + 0x10;
-            
-            codepoint = *backrefCountStream++;
-            u32 backrefs = static_cast<u32>(codepoint);
-            if (codepoint > 0xf)
-                backrefs = cVertexGroupEncodingTable[codepoint - 0x10][1] + bitStream.ReadForwards(cVertexGroupEncodingTable[codepoint - 0x10][0]) + 0x10;
+            const u8 vertexCodepoint = *vertexCountStream++;
+            const u8 backrefCodepoint = *backrefCountStream++;
+            if ((vertexCodepoint | backrefCodepoint) > 0xf)
+                bitStream.Refill();
+            u32 vertCount = DecodeGroupCount(vertexCodepoint, bitStream);
+            u32 backrefs = DecodeGroupCount(backrefCodepoint, bitStream);
 
             u16 codepointo = *backrefOffsetStream++;
             u32 backrefIndex = static_cast<u32>(codepointo);
             s32 backrefOffset;
             if (codepointo > 2) {
                 const u32 nbits = (codepointo - 3) & 0x1f;
-                const u64 value = bitStream.ReadForwards(nbits);
-                backrefOffset = (((codepointo - 3) >> 5) << a6) + ((nbits == 0 ? 0 : value) + ~(-1 << nbits)) * stride;
+                const u64 value = bitStream.Read(nbits);
+                backrefOffset = (((codepointo - 3) >> 5) << a6) + (value + ~(-1 << nbits)) * stride;
                 baseGroup += advanceIndex + 1;
                 advanceIndex = 0;
             } else {
@@ -321,10 +343,10 @@ u32 Parse(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputSt
         }
     }
 
-    u8 codepoint = *vertexCountStream++;
-    u32 vertCount = static_cast<u32>(codepoint);
-    if (codepoint > 0xf)
-        vertCount = cVertexGroupEncodingTable[codepoint - 0x10][1] + bitStream.ReadForwards(cVertexGroupEncodingTable[codepoint - 0x10][0]) + 0x10;
+    const u8 vertexCodepoint = *vertexCountStream++;
+    if (vertexCodepoint > 0xf)
+        bitStream.Refill();
+    u32 vertCount = DecodeGroupCount(vertexCodepoint, bitStream);
 
     u32 backrefCount = 0;
     u32 backrefOffset = 0;
@@ -339,8 +361,8 @@ u32 Parse(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputSt
             backrefOffset = (baseGroup - backrefIndex)->backRefOffset;
         } else {
             const u32 nbits = (codepointo - 3) & 0x1f;
-            const u64 value = bitStream.ReadForwards(nbits);
-            backrefOffset = (((codepointo - 3) >> 5) << a6) + ((nbits == 0 ? 0 : value) + ~(-1 << nbits)) * stride;
+            const u64 value = bitStream.Read(nbits);
+            backrefOffset = (((codepointo - 3) >> 5) << a6) + (value + ~(-1 << nbits)) * stride;
         }
     }
 
@@ -353,6 +375,29 @@ u32 Parse(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputSt
     return vertCount + vertexCount;
 }
 
+static u32 ParseGeneric(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputStreams, ForwardBitStreamReader& bitStream, u32 stride, u32 a6, u32 format, u32 totalVertexCount) {
+    return ParseImpl(groups, count, inputStreams, bitStream, stride, a6, format, totalVertexCount);
+}
+
+#ifdef MC_X86_DISPATCH
+MC_TARGET_BMI2 static u32 ParseBMI2(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputStreams, ForwardBitStreamReader& bitStream, u32 stride, u32 a6, u32 format, u32 totalVertexCount) {
+    return ParseImpl(groups, count, inputStreams, bitStream, stride, a6, format, totalVertexCount);
+}
+#endif
+
+u32 Parse(VertexDecodeGroup* groups, s32 count, VertexDecodingStreamSet& inputStreams, BitStreamReader& bitStream, u32 stride, u32 a6, u32 format, u32 totalVertexCount) {
+    ForwardBitStreamReader reader(bitStream);
+    u32 vertexCount;
+#ifdef MC_X86_DISPATCH
+    if (HasBMI2())
+        vertexCount = ParseBMI2(groups, count, inputStreams, reader, stride, a6, format, totalVertexCount);
+    else
+#endif
+        vertexCount = ParseGeneric(groups, count, inputStreams, reader, stride, a6, format, totalVertexCount);
+    reader.Store(bitStream);
+    return vertexCount;
+}
+
 void VertexDecompContext::FinishGroupProcessing(StackAllocator* allocator) {
     if ((stage == 0 || stage == 1) && groups) {
         allocator->Free(groups);
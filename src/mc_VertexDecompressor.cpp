@@ -5,11 +5,13 @@
 
 #include "mc_Zstd.h"
 
+#include <cstring> // std::memcpy, std::memset
+
 namespace mc {
 
 void VertexDecompressor::Initialize(u32, ZSTD_DCtx* dctx, StackAllocator* allocator) {
     mDCtx = dctx;
-    mBuffer = reinterpret_cast<u8*>(allocator->Alloc(0x80000, 8));
+    mBuffer = reinterpret_cast<u8*>(allocator->Alloc(cRingBufferSize, 8));
     mOffset = 0;
     mBufferSize = 0x80000;
     mDecodingContext = allocator->Create<DecodingContext>();
@@ -17,6 +19,33 @@ void VertexDecompressor::Initialize(u32, ZSTD_DCtx* dctx, StackAllocator* alloca
     mDecodingContext->_10._20 = 0;
 }
 
+void VertexDecompressor::Reset() {
+    mOffset = 0;
+    mBufferSize = 0x80000;
+    mDecodingContext->_10._20 = 0;
+}
+
+void VertexDecompressor::SaveState(State& state) const {
+    state.offset = mOffset;
+    state.bufferSize = mBufferSize;
+    state.decodingContext = *mDecodingContext;
+}
+
+void VertexDecompressor::RestoreState(const State& state) {
+    mOffset = state.offset;
+    mBufferSize = state.bufferSize;
+    *mDecodingContext = state.decodingContext;
+    std::memset(mBuffer, 0, cRingBufferSize);
+}
+
+void VertexDecompressor::SaveRingBuffer(u8* dst) const {
+    std::memcpy(dst, mBuffer, cRingBufferSize);
+}
+
+void VertexDecompressor::RestoreRingBuffer(const u8* src) {
+    std::memcpy(mBuffer, src, cRingBufferSize);
+}
+
 void VertexDecompressor::Finalize() {
     mStackAllocator->Free(mDecodingContext);
     mStackAllocator->Free(mBuffer);
@@ -0,0 +1,84 @@
+#include "batch_pipeline.h"
+
+#include "mc_DecoderSession.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <thread>
+
+static bool DecodeBuffer(mc::DecoderSession& session, std::span<const mc::u8> src, std::vector<mc::u8>& output) {
+    const mc::DecodeRequirements req = mc::QueryRequirements(src.data(), src.size());
+    if (req.type == mc::FileType::Invalid || !session.Reserve(req.workMemorySize))
+        return false;
+
+    output.resize(req.decompressedSize);
+    switch (req.type) {
+        case mc::FileType::MeshCodecPackage:
+            return session.Decode(output.data(), output.size(), src.data(), src.size());
+        case mc::FileType::Chunk:
+            return session.DecodeChunk(output.data(), output.size(), src.data(), src.size());
+        case mc::FileType::Quad:
+            return session.DecodeQuad(output.data(), output.size(), src.data(), src.size());
+        default:
+            return false;
+    }
+}
+
+size_t DecompressPipelined(FileIO& io, const std::vector<std::filesystem::path>& paths, const std::filesystem::path& dirPath,
+                           const std::filesystem::path& outputPath, unsigned int decodeThreads, unsigned int readAhead,
+                           const std::function<void(const std::filesystem::path& path, bool success, size_t outputSize)>& onFileDone,
+                           const mc::DecodeOptions& options) {
+    std::atomic<size_t> nextRead = 0;
+    std::atomic<size_t> nextResult = 0;
+    std::atomic<size_t> failedFiles = 0;
+    std::mutex directoryMutex;
+
+    // every read that's started is picked up by exactly one decode thread
+    const size_t initialReads = std::min<size_t>(std::max(readAhead, 1u), paths.size());
+    for (; nextRead < initialReads; ++nextRead)
+        io.StartRead(nextRead, paths[nextRead]);
+
+    auto worker = [&] {
+        mc::DecoderSession session;
+        session.SetOptions(options);
+        while (nextResult++ < paths.size()) {
+            ReadResult input = io.WaitForRead();
+
+            const size_t readIndex = nextRead++;
+            if (readIndex < paths.size())
+                io.StartRead(readIndex, paths[readIndex]);
+
+            const std::filesystem::path& path = paths[input.index];
+            std::vector<mc::u8> output;
+            const bool success = input.success && DecodeBuffer(session, input.data, output);
+            input.data = {}; // don't hold on to the input while waiting for a write slot
+
+            const size_t outputSize = output.size();
+            if (success) {
+                const std::filesystem::path outputDir = outputPath / std::filesystem::relative(path.parent_path(), dirPath);
+                {
+                    std::lock_guard lock(directoryMutex);
+                    std::error_code ec;
+                    std::filesystem::create_directories(outputDir, ec);
+                }
+                io.StartWrite(outputDir / path.stem(), std::move(output));
+            } else {
+                ++failedFiles;
+            }
+
+            if (onFileDone)
+                onFileDone(path, success, outputSize);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < decodeThreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return failedFiles + io.FinishWrites();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "file_io.h"
+
+#include "mc_DecodeOptions.h"
+
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+// decodes every file with decodeThreads threads (each with its own DecoderSession) while io keeps readAhead reads
+// going in front of them and writes the outputs behind them, so decoding and disk access overlap
+// onFileDone is called from the decode threads, returns the number of files that failed to read, decode or write
+size_t DecompressPipelined(FileIO& io, const std::vector<std::filesystem::path>& paths, const std::filesystem::path& dirPath,
+                           const std::filesystem::path& outputPath, unsigned int decodeThreads, unsigned int readAhead,
+                           const std::function<void(const std::filesystem::path& path, bool success, size_t outputSize)>& onFileDone,
+                           const mc::DecodeOptions& options = {});
@@ -0,0 +1,585 @@
+#include "bench.h"
+#include "mapped_file.h"
+
+#include "mc_ArenaProvider.h"
+#include "mc_DecoderSession.h"
+#include "mc_MeshBlockIndex.h"
+
+#include "mc_BitStream.h"
+#include "mc_VertexCodec.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+
+struct BenchInput {
+    std::vector<mc::u8> data;
+    mc::DecodeRequirements req;
+};
+
+// everything is read up front so only decoding is timed
+static std::vector<BenchInput> LoadInputs(const std::vector<std::filesystem::path>& paths) {
+    std::vector<BenchInput> inputs;
+    for (const std::filesystem::path& path : paths) {
+        InputFile file;
+        if (!file.Open(path))
+            continue;
+        const std::span<const mc::u8> data = file.GetData();
+        const mc::DecodeRequirements req = mc::QueryRequirements(data.data(), data.size());
+        if (req.type != mc::FileType::Invalid)
+            inputs.push_back({ std::vector<mc::u8>(data.begin(), data.end()), req });
+    }
+    return inputs;
+}
+
+static bool DecodeInput(mc::DecoderSession& session, const BenchInput& input, std::vector<mc::u8>& output) {
+    switch (input.req.type) {
+        case mc::FileType::MeshCodecPackage:
+            return session.Decode(output.data(), output.size(), input.data.data(), input.data.size());
+        case mc::FileType::Chunk:
+            return session.DecodeChunk(output.data(), output.size(), input.data.data(), input.data.size());
+        case mc::FileType::Quad:
+            return session.DecodeQuad(output.data(), output.size(), input.data.data(), input.data.size());
+        default:
+            return false;
+    }
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int BenchArena(const std::vector<std::filesystem::path>& paths, unsigned int rounds) {
+    const std::vector<BenchInput> inputs = LoadInputs(paths);
+    if (inputs.empty()) {
+        std::cout << "no files to decode\n";
+        return 1;
+    }
+
+    size_t workMemorySize = 0;
+    size_t outputSize = 0;
+    size_t totalOutput = 0;
+    for (const BenchInput& input : inputs) {
+        workMemorySize = std::max(workMemorySize, input.req.workMemorySize);
+        outputSize = std::max(outputSize, input.req.decompressedSize);
+        totalOutput += input.req.decompressedSize;
+    }
+    std::vector<mc::u8> output(outputSize);
+
+    mc::HugePageArenaProvider transparentHugePages({ .useHugeTLB = false, .prefault = true });
+    mc::HugePageArenaProvider hugeTLB({ .useHugeTLB = true, .prefault = true });
+    const std::pair<const char*, mc::ArenaProvider*> providers[] = {
+        { "malloc", &mc::GetMallocArenaProvider() },
+        { "thp", &transparentHugePages },
+        { "hugetlb", &hugeTLB },
+    };
+
+    std::cout << inputs.size() << " files, " << totalOutput / (1024.0 * 1024.0) << " MB of output per round, "
+              << workMemorySize / (1024.0 * 1024.0) << " MB of work memory\n\n";
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(10) << "arena" << std::setw(14) << "setup (ms)" << std::setw(18) << "first round (s)" << std::setw(16) << "best round (s)"
+              << std::setw(14) << "best MB/s" << "\n";
+
+    int failed = 0;
+    for (const auto& [name, provider] : providers) {
+        mc::DecoderSession session;
+        session.SetOptions({ .arenaProvider = provider });
+
+        auto start = std::chrono::steady_clock::now();
+        if (!session.Reserve(workMemorySize)) {
+            std::cout << std::setw(10) << name << "  failed to allocate work memory\n";
+            continue;
+        }
+        const double setupSeconds = SecondsSince(start);
+
+        double firstRound = 0.0;
+        double bestRound = 0.0;
+        for (unsigned int round = 0; round < std::max(rounds, 1u); ++round) {
+            start = std::chrono::steady_clock::now();
+            for (const BenchInput& input : inputs) {
+                if (!DecodeInput(session, input, output))
+                    ++failed;
+            }
+            const double seconds = SecondsSince(start);
+            if (round == 0)
+                firstRound = seconds;
+            bestRound = round == 0 ? seconds : std::min(bestRound, seconds);
+        }
+
+        std::cout << std::setw(10) << name << std::setw(14) << setupSeconds * 1000.0 << std::setw(18) << firstRound << std::setw(16) << bestRound
+                  << std::setw(14) << totalOutput / (1024.0 * 1024.0) / bestRound << "\n";
+    }
+
+    if (failed != 0)
+        std::cout << failed << " decodes failed\n";
+
+    return failed == 0 ? 0 : 1;
+}
+
+int BenchBlocks(const std::vector<std::filesystem::path>& paths, unsigned int threadCount) {
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(40) << "file" << std::setw(10) << "meshes" << std::setw(10) << "restarts" << std::setw(16) << "analyze (ms)"
+              << std::setw(16) << "serial (ms)" << std::setw(16) << "parallel (ms)" << "\n";
+
+    int failed = 0;
+    for (const std::filesystem::path& path : paths) {
+        const std::vector<BenchInput> loaded = LoadInputs({ path });
+        if (loaded.empty() || loaded[0].req.type != mc::FileType::Chunk)
+            continue;
+        const BenchInput& input = loaded[0];
+        const std::string name = path.filename().string();
+
+        std::vector<mc::u8> workMemory(input.req.workMemorySize);
+        std::vector<mc::u8> analyzed(input.req.decompressedSize);
+        std::vector<mc::u8> serial(input.req.decompressedSize);
+        std::vector<mc::u8> parallel(input.req.decompressedSize);
+
+        auto start = std::chrono::steady_clock::now();
+        mc::MeshBlockIndex blockIndex;
+        if (!mc::AnalyzeChunk(analyzed.data(), analyzed.size(), input.data.data(), input.data.size(), blockIndex)) {
+            std::cout << std::setw(40) << name << "  failed to analyze\n";
+            ++failed;
+            continue;
+        }
+        const double analyzeSeconds = SecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        const bool serialSuccess = mc::DecompressChunk(serial.data(), serial.size(), input.data.data(), input.data.size(), workMemory.data(), workMemory.size());
+        const double serialSeconds = SecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        const bool parallelSuccess = mc::DecompressChunkParallel(parallel.data(), parallel.size(), input.data.data(), input.data.size(), blockIndex, threadCount);
+        const double parallelSeconds = SecondsSince(start);
+
+        std::cout << std::setw(40) << name << std::setw(10) << blockIndex.blocks.size() << std::setw(10) << blockIndex.GetRestartPointCount()
+                  << std::setw(16) << analyzeSeconds * 1000.0 << std::setw(16) << serialSeconds * 1000.0 << std::setw(16) << parallelSeconds * 1000.0;
+        // the buffers all start out zeroed so the padding matches as well
+        if (!serialSuccess || !parallelSuccess || serial != parallel || serial != analyzed) {
+            std::cout << "  output mismatch";
+            ++failed;
+        }
+        std::cout << "\n";
+    }
+
+    if (failed != 0)
+        std::cout << failed << " files failed\n";
+
+    return failed == 0 ? 0 : 1;
+}
+
+int BenchSeek(const std::vector<std::filesystem::path>& paths) {
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(40) << "file" << std::setw(10) << "meshes" << std::setw(10) << "restarts" << std::setw(11) << "snapshots"
+              << std::setw(14) << "index (KB)" << std::setw(16) << "analyze (ms)" << std::setw(18) << "per mesh (ms)" << "\n";
+
+    int failed = 0;
+    for (const std::filesystem::path& path : paths) {
+        const std::vector<BenchInput> loaded = LoadInputs({ path });
+        if (loaded.empty() || (loaded[0].req.type != mc::FileType::Chunk && loaded[0].req.type != mc::FileType::MeshCodecPackage))
+            continue;
+        const BenchInput& input = loaded[0];
+        const std::string name = path.filename().string();
+
+        std::vector<mc::u8> analyzed(input.req.decompressedSize);
+        auto start = std::chrono::steady_clock::now();
+        mc::MeshBlockIndex analyzedIndex;
+        const bool analyzeSuccess = input.req.type == mc::FileType::Chunk
+            ? mc::AnalyzeChunk(analyzed.data(), analyzed.size(), input.data.data(), input.data.size(), analyzedIndex, true)
+            : mc::AnalyzeMC(analyzed.data(), analyzed.size(), input.data.data(), input.data.size(), analyzedIndex, true);
+        const double analyzeSeconds = SecondsSince(start);
+
+        // everything below uses the index as loaded back from the sidecar format
+        std::vector<mc::u8> sidecar;
+        mc::MeshBlockIndex blockIndex;
+        if (analyzeSuccess)
+            mc::SaveMeshBlockIndex(analyzedIndex, sidecar);
+        if (!analyzeSuccess || !mc::LoadMeshBlockIndex(sidecar.data(), sidecar.size(), blockIndex)) {
+            std::cout << std::setw(40) << name << "  failed to analyze\n";
+            ++failed;
+            continue;
+        }
+        if (blockIndex.blocks.empty())
+            continue;
+
+        // same alignment as the analyzed output, the vertex buffer offset of .bfres.mc files depends on it
+        std::vector<mc::u8> workMemory(input.req.workMemorySize);
+        std::vector<mc::u8> buffer(analyzed.size() + 0x100);
+        mc::u8* mesh = buffer.data() + ((reinterpret_cast<uintptr_t>(analyzed.data()) - reinterpret_cast<uintptr_t>(buffer.data())) & 0xff);
+
+        const mc::u32 blockCount = static_cast<mc::u32>(blockIndex.blocks.size());
+        double decodeSeconds = 0.0;
+        mc::u32 mismatches = 0;
+        for (mc::u32 i = 0; i < blockCount; ++i) {
+            std::fill(buffer.begin(), buffer.end(), 0);
+            start = std::chrono::steady_clock::now();
+            const bool success = mc::DecodeMesh(mesh, analyzed.size(), input.data.data(), input.data.size(), workMemory.data(), workMemory.size(), blockIndex, i);
+            decodeSeconds += SecondsSince(start);
+
+            const mc::MeshBlockIndex::Block& block = blockIndex.blocks[i];
+            const mc::u32 vertexStart = blockIndex.vertexBufferOffset + block.vertexOffset;
+            const mc::u32 vertexEnd = blockIndex.vertexBufferOffset + (i + 1 < blockCount ? blockIndex.blocks[i + 1].vertexOffset : blockIndex.vertexBufferSize);
+            const mc::u32 indexStart = blockIndex.indexBufferOffset + block.indexOffset;
+            const mc::u32 indexEnd = blockIndex.indexBufferOffset + (i + 1 < blockCount ? blockIndex.blocks[i + 1].indexOffset : blockIndex.indexBufferSize);
+            if (!success || !std::equal(mesh + vertexStart, mesh + vertexEnd, analyzed.data() + vertexStart) ||
+                !std::equal(mesh + indexStart, mesh + indexEnd, analyzed.data() + indexStart))
+                ++mismatches;
+        }
+
+        std::cout << std::setw(40) << name << std::setw(10) << blockCount << std::setw(10) << blockIndex.GetRestartPointCount()
+                  << std::setw(11) << blockIndex.GetSnapshotCount() << std::setw(14) << sidecar.size() / 1024.0 << std::setw(16) << analyzeSeconds * 1000.0
+                  << std::setw(18) << decodeSeconds * 1000.0 / blockCount;
+        if (mismatches != 0) {
+            std::cout << "  " << mismatches << " meshes mismatch";
+            ++failed;
+        }
+        std::cout << "\n";
+    }
+
+    if (failed != 0)
+        std::cout << failed << " files failed\n";
+
+    return failed == 0 ? 0 : 1;
+}
+
+// the bit field sizes come in pairs that add up to at most 56 bits so the batched readers can take both out of one refill
+struct BitReadInput {
+    std::vector<mc::u64> stream;    // padded on both ends
+    std::vector<mc::u8> sizes;
+    size_t totalBits;
+};
+
+using BitReadFunc = mc::u64 (*)(const BitReadInput& input);
+
+static mc::u64 ReadForwardsPlain(const BitReadInput& input) {
+    mc::BitStreamReader reader(input.stream.data() + 1, mc::BitStreamReader::Direction::Forwards);
+    mc::u64 checksum = 0;
+    for (const mc::u8 nbits : input.sizes)
+        checksum += reader.ReadForwards(nbits);
+    return checksum;
+}
+
+static mc::u64 ReadDirectional(const BitReadInput& input) {
+    mc::BitStreamReader reader(input.stream.data() + 1, mc::BitStreamReader::Direction::Forwards);
+    mc::u64 checksum = 0;
+    for (const mc::u8 nbits : input.sizes)
+        checksum += reader.DirectionalRead(nbits);
+    return checksum;
+}
+
+static mc::u64 ReadBackwardsPlain(const BitReadInput& input) {
+    mc::BitStreamReader reader(input.stream.data() + input.stream.size() - 2, mc::BitStreamReader::Direction::Backwards);
+    mc::u64 checksum = 0;
+    for (const mc::u8 nbits : input.sizes)
+        checksum += reader.Read(nbits);
+    return checksum;
+}
+
+template <mc::BitStreamReader::Direction Dir>
+static MC_FORCE_INLINE mc::u64 ReadFixed(const BitReadInput& input) {
+    const mc::u64* start = Dir == mc::BitStreamReader::Direction::Forwards ? input.stream.data() + 1 : input.stream.data() + input.stream.size() - 2;
+    mc::FixedBitStreamReader<Dir> reader(start);
+    mc::u64 checksum = 0;
+    for (const mc::u8 nbits : input.sizes)
+        checksum += reader.Read(nbits);
+    return checksum;
+}
+
+template <mc::BitStreamReader::Direction Dir>
+static MC_FORCE_INLINE mc::u64 ReadFixedBatched(const BitReadInput& input) {
+    const mc::u64* start = Dir == mc::BitStreamReader::Direction::Forwards ? input.stream.data() + 1 : input.stream.data() + input.stream.size() - 2;
+    mc::FixedBitStreamReader<Dir> reader(start);
+    mc::u64 checksum = 0;
+    for (size_t i = 0; i < input.sizes.size(); i += 2) {
+        reader.Refill();
+        checksum += reader.Take(input.sizes[i]);
+        checksum += reader.Take(input.sizes[i + 1]);
+    }
+    return checksum;
+}
+
+static mc::u64 ReadForwardsFixed(const BitReadInput& input) {
+    return ReadFixed<mc::BitStreamReader::Direction::Forwards>(input);
+}
+static mc::u64 ReadForwardsBatched(const BitReadInput& input) {
+    return ReadFixedBatched<mc::BitStreamReader::Direction::Forwards>(input);
+}
+static mc::u64 ReadBackwardsFixed(const BitReadInput& input) {
+    return ReadFixed<mc::BitStreamReader::Direction::Backwards>(input);
+}
+static mc::u64 ReadBackwardsBatched(const BitReadInput& input) {
+    return ReadFixedBatched<mc::BitStreamReader::Direction::Backwards>(input);
+}
+
+#ifdef MC_X86_DISPATCH
+MC_TARGET_BMI2 static mc::u64 ReadForwardsFixedBMI2(const BitReadInput& input) {
+    return ReadFixed<mc::BitStreamReader::Direction::Forwards>(input);
+}
+MC_TARGET_BMI2 static mc::u64 ReadForwardsBatchedBMI2(const BitReadInput& input) {
+    return ReadFixedBatched<mc::BitStreamReader::Direction::Forwards>(input);
+}
+MC_TARGET_BMI2 static mc::u64 ReadBackwardsFixedBMI2(const BitReadInput& input) {
+    return ReadFixed<mc::BitStreamReader::Direction::Backwards>(input);
+}
+MC_TARGET_BMI2 static mc::u64 ReadBackwardsBatchedBMI2(const BitReadInput& input) {
+    return ReadFixedBatched<mc::BitStreamReader::Direction::Backwards>(input);
+}
+#endif
+
+int BenchBitReaders(unsigned int megabytes) {
+    BitReadInput input;
+    std::mt19937_64 rng(0x4d455348);
+    input.stream.resize(std::max(megabytes, 1u) * (1024 * 1024 / sizeof(mc::u64)) + 2);
+    for (mc::u64& value : input.stream)
+        value = rng();
+
+    // stop a word short of the end so the last refill still has something to load
+    const size_t availableBits = (input.stream.size() - 3) * 64;
+    input.totalBits = 0;
+    std::uniform_int_distribution<unsigned int> sizeDist(1, 28);
+    while (true) {
+        const mc::u8 first = static_cast<mc::u8>(sizeDist(rng));
+        const mc::u8 second = static_cast<mc::u8>(sizeDist(rng));
+        if (input.totalBits + first + second > availableBits)
+            break;
+        input.sizes.push_back(first);
+        input.sizes.push_back(second);
+        input.totalBits += first + second;
+    }
+
+    struct Variant {
+        const char* name;
+        BitReadFunc func;
+        bool forwards;
+    };
+    std::vector<Variant> variants = {
+        { "forwards ReadForwards", ReadForwardsPlain, true },
+        { "forwards DirectionalRead", ReadDirectional, true },
+        { "forwards fixed", ReadForwardsFixed, true },
+        { "forwards fixed batched", ReadForwardsBatched, true },
+        { "backwards Read", ReadBackwardsPlain, false },
+        { "backwards fixed", ReadBackwardsFixed, false },
+        { "backwards fixed batched", ReadBackwardsBatched, false },
+    };
+#ifdef MC_X86_DISPATCH
+    if (mc::HasBMI2()) {
+        variants.push_back({ "forwards fixed bmi2", ReadForwardsFixedBMI2, true });
+        variants.push_back({ "forwards fixed batched bmi2", ReadForwardsBatchedBMI2, true });
+        variants.push_back({ "backwards fixed bmi2", ReadBackwardsFixedBMI2, false });
+        variants.push_back({ "backwards fixed batched bmi2", ReadBackwardsBatchedBMI2, false });
+    }
+#endif
+
+    std::cout << input.sizes.size() << " reads, " << input.totalBits / (8.0 * 1024.0 * 1024.0) << " MB of bit fields"
+              << (mc::HasBMI2() ? "" : " (no bmi2)") << "\n\n";
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(32) << "reader" << std::setw(16) << "best (ms)" << std::setw(16) << "Gbit/s" << "\n";
+
+    // every reader has to give the same values as the plain one for its direction
+    int failed = 0;
+    const mc::u64 forwardChecksum = ReadForwardsPlain(input);
+    const mc::u64 backwardChecksum = ReadBackwardsPlain(input);
+    for (const Variant& variant : variants) {
+        double best = 0.0;
+        mc::u64 checksum = 0;
+        for (unsigned int round = 0; round < 5; ++round) {
+            const auto start = std::chrono::steady_clock::now();
+            checksum = variant.func(input);
+            const double seconds = SecondsSince(start);
+            best = round == 0 ? seconds : std::min(best, seconds);
+        }
+
+        std::cout << std::setw(32) << variant.name << std::setw(16) << best * 1000.0 << std::setw(16) << input.totalBits / best / 1e9;
+        if (checksum != (variant.forwards ? forwardChecksum : backwardChecksum)) {
+            std::cout << "  mismatch";
+            ++failed;
+        }
+        std::cout << "\n";
+    }
+
+    return failed == 0 ? 0 : 1;
+}
+
+int BenchTables(const std::vector<std::filesystem::path>& paths) {
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(40) << "file" << std::setw(10) << "tables" << std::setw(10) << "hits" << std::setw(12) << "hit rate"
+              << std::setw(16) << "built (ms)" << std::setw(16) << "cached (ms)" << "\n";
+
+    mc::DecoderSession session;
+    mc::u64 totalHits = 0;
+    mc::u64 totalTables = 0;
+    double totalBuilt = 0.0;
+    double totalCached = 0.0;
+    int failed = 0;
+    for (const std::filesystem::path& path : paths) {
+        const std::vector<BenchInput> loaded = LoadInputs({ path });
+        if (loaded.empty())
+            continue;
+        const BenchInput& input = loaded[0];
+        const std::string name = path.filename().string();
+
+        std::vector<mc::u8> built(input.req.decompressedSize);
+        std::vector<mc::u8> cached(input.req.decompressedSize);
+
+        mc::SetDecodingTableCache(false);
+        auto start = std::chrono::steady_clock::now();
+        const bool builtSuccess = DecodeInput(session, input, built);
+        const double builtSeconds = SecondsSince(start);
+
+        // the cache is kept from the previous files, tables shared between files are part of what this is measuring
+        mc::SetDecodingTableCache(true);
+        mc::ResetDecodingTableCacheStats();
+        start = std::chrono::steady_clock::now();
+        const bool cachedSuccess = DecodeInput(session, input, cached);
+        const double cachedSeconds = SecondsSince(start);
+        const mc::DecodingTableCacheStats stats = mc::GetDecodingTableCacheStats();
+
+        const mc::u64 tables = stats.hits + stats.misses;
+        std::cout << std::setw(40) << name << std::setw(10) << tables << std::setw(10) << stats.hits
+                  << std::setw(11) << (tables != 0 ? 100.0 * stats.hits / tables : 0.0) << "%" << std::setw(16) << builtSeconds * 1000.0
+                  << std::setw(16) << cachedSeconds * 1000.0;
+        if (!builtSuccess || !cachedSuccess || built != cached) {
+            std::cout << "  output mismatch";
+            ++failed;
+        }
+        std::cout << "\n";
+
+        totalHits += stats.hits;
+        totalTables += tables;
+        totalBuilt += builtSeconds;
+        totalCached += cachedSeconds;
+    }
+
+    std::cout << std::setw(40) << "total" << std::setw(10) << totalTables << std::setw(10) << totalHits
+              << std::setw(11) << (totalTables != 0 ? 100.0 * totalHits / totalTables : 0.0) << "%" << std::setw(16) << totalBuilt * 1000.0
+              << std::setw(16) << totalCached * 1000.0 << "\n";
+    if (failed != 0)
+        std::cout << failed << " files failed\n";
+
+    return failed == 0 ? 0 : 1;
+}
+
+struct EntropyResult {
+    double seconds;
+    std::vector<mc::u8> output;
+};
+
+static constexpr mc::u32 cEntropyBitSize = 11;
+
+// random states refilled from random words, the _00 table doesn't have to be valid for the decoders to give the same output
+static EntropyResult RunDecodeFunction0(const mc::DecodingContext& table, const std::vector<mc::u32>& stream, mc::u32 count, mc::u64 seed) {
+    std::mt19937_64 rng(seed);
+    mc::Encoding1Struct state{};
+    state._20 = 0xf;
+    for (mc::u64& value : state.indexMasks)
+        value = rng() >> 1 | 0x80000000;
+
+    EntropyResult result{ 0.0, std::vector<mc::u8>(count) };
+    mc::DecodeInfo<mc::u8> info{ result.output.data(), static_cast<mc::s32>(count), static_cast<mc::s32>(count), 1 };
+    mc::BufferView view{ reinterpret_cast<const mc::u8*>(stream.data()), 0, 0 };
+    const auto start = std::chrono::steady_clock::now();
+    mc::DecodeFunction0(state, info, view, table.decodingTable, cEntropyBitSize);
+    result.seconds = SecondsSince(start);
+    return result;
+}
+
+static EntropyResult RunDecodeFunction1(const std::vector<mc::u32>& table, const std::vector<mc::u64> (&streams)[3], mc::u32 count) {
+    mc::DecompContext ctx{};
+    ctx.bitStream0 = mc::BitStreamReader(streams[0].data() + streams[0].size() - 2, mc::BitStreamReader::Direction::Backwards);
+    ctx.bitStream1 = mc::BitStreamReader(streams[1].data() + 1, mc::BitStreamReader::Direction::Forwards);
+    ctx.bitStream2 = mc::BitStreamReader(streams[2].data() + streams[2].size() - 2, mc::BitStreamReader::Direction::Backwards);
+
+    EntropyResult result{ 0.0, std::vector<mc::u8>(count + 3) };
+    const auto start = std::chrono::steady_clock::now();
+    mc::DecodeFunction1(result.output.data(), 1, count, ctx, table.data(), cEntropyBitSize);
+    result.seconds = SecondsSince(start);
+    return result;
+}
+
+int BenchEntropy(unsigned int megabytes) {
+    const mc::u32 count = std::max(megabytes, 1u) * 1024 * 1024;
+    std::mt19937_64 rng(0x4d455348);
+
+    // DecodeFunction0 takes at most a word per symbol
+    static mc::DecodingContext table0;
+    for (mc::u16& entry : table0.decodingTable)
+        entry = static_cast<mc::u16>(rng());
+    mc::u32* values = reinterpret_cast<mc::u32*>(table0.decodingTable);
+    for (mc::u32 i = 0; i < 1u << cEntropyBitSize; ++i)
+        values[i] = static_cast<mc::u32>(rng() % 0x1000 + 1) << 0x10 | static_cast<mc::u32>(rng() & 0xffff);
+    std::vector<mc::u32> stream0(count + 4);
+    for (mc::u32& word : stream0)
+        word = static_cast<mc::u32>(rng());
+
+    // DecodeFunction1 takes at most cEntropyBitSize bits per symbol from each stream, the multi symbol tables only give the same output
+    // for valid prefix tables and only get used when every code is at most a third of the index bits (see UseMultiSymbolTable), so this
+    // is a canonical one (the codes in order of length) with a 1, a 2 and two 3 bit codes
+    std::vector<mc::u32> table1(1u << cEntropyBitSize);
+    mc::u32 tableIndex = 0;
+    for (const mc::u32 codeLength : { 1u, 2u, 3u, 3u }) {
+        const mc::u32 span = 1u << (cEntropyBitSize - codeLength);
+        std::fill_n(table1.begin() + tableIndex, span, static_cast<mc::u32>(rng() & 0xff) | codeLength << 0x10);
+        tableIndex += span;
+    }
+    std::vector<mc::u64> streams1[3];
+    for (std::vector<mc::u64>& stream : streams1) {
+        stream.resize(count / 3 * cEntropyBitSize / 64 + 4);
+        for (mc::u64& word : stream)
+            word = rng();
+    }
+
+    std::cout << count / (1024.0 * 1024.0) << "M symbols per run" << (mc::HasAVX2() ? "" : " (no avx2)") << "\n\n";
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::setw(24) << "decoder" << std::setw(14) << "path" << std::setw(16) << "best (ms)" << std::setw(16) << "Msymbols/s" << "\n";
+
+    struct EntropyPath {
+        const char* name;
+        bool multiSymbol;
+        bool gather;
+    };
+    static constexpr EntropyPath cPaths[] = {
+        { "portable", false, false },
+        { "multi-symbol", true, false },
+        { "avx2", false, true },
+    };
+
+    int failed = 0;
+    for (const char* name : { "DecodeFunction0", "DecodeFunction1" }) {
+        const bool isFunction0 = name[14] == '0';
+        std::vector<mc::u8> reference;
+        for (const EntropyPath& path : cPaths) {
+            // only _01 streams have multi symbol tables
+            if (path.multiSymbol && isFunction0)
+                continue;
+            mc::SetMultiSymbolTables(path.multiSymbol);
+            mc::SetGatherDecoders(path.gather);
+            if (path.gather && !mc::UseGatherDecoders())
+                continue;
+
+            double best = 0.0;
+            bool mismatch = false;
+            for (unsigned int round = 0; round < 5; ++round) {
+                EntropyResult result = isFunction0 ? RunDecodeFunction0(table0, stream0, count, 1) : RunDecodeFunction1(table1, streams1, count);
+                best = round == 0 ? result.seconds : std::min(best, result.seconds);
+                if (reference.empty())
+                    reference = std::move(result.output);
+                else if (result.output != reference)
+                    mismatch = true;
+            }
+
+            std::cout << std::setw(24) << name << std::setw(14) << path.name << std::setw(16) << best * 1000.0
+                      << std::setw(16) << count / best / 1e6;
+            if (mismatch) {
+                std::cout << "  mismatch";
+                ++failed;
+            }
+            std::cout << "\n";
+        }
+    }
+    mc::SetMultiSymbolTables(true);
+    mc::SetGatherDecoders(false);
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+// decodes every file rounds times with malloc'd work memory and with huge page backed work memory (transparent and hugetlbfs)
+// and prints how long setting up the work memory and decoding took with each
+int BenchArena(const std::vector<std::filesystem::path>& paths, unsigned int rounds);
+
+// finds the restart points of every .chunk file (see mc_MeshBlockIndex.h), then times a regular decode against one spread over threadCount
+// threads (0 = one per hardware thread) and checks that both give the same output
+int BenchBlocks(const std::vector<std::filesystem::path>& paths, unsigned int threadCount);
+
+// builds a seekable index with snapshots for every .chunk and .bfres.mc file, round trips it through the sidecar format and decodes
+// every mesh on its own with DecodeMesh, checking it against the full decode and printing how long that took on average
+int BenchSeek(const std::vector<std::filesystem::path>& paths);
+
+// decodes every file with the byte stream decoding table cache off and then on (see SetDecodingTableCache), checks that both give the
+// same output and prints how many of the tables came out of the cache and how long each decode took, the cache is kept from one file
+// to the next like it would be when decoding them all on the same thread
+int BenchTables(const std::vector<std::filesystem::path>& paths);
+
+// reads megabytes worth of random bit fields (1 to 28 bits, like the vertex group counts) with the plain BitStreamReader and with the
+// fixed direction readers (one refill per read and one per two reads, plus the bmi2 builds if the cpu has it) and prints the bits/s of each
+int BenchBitReaders(unsigned int megabytes);
+
+// decodes megabytes worth of symbols with the byte stream entropy decoders (DecodeFunction0 for ByteStreamEncoding::_00, DecodeFunction1
+// for _01) from synthetic 11 bit tables and random streams, with the portable paths, the multi symbol tables for _01 (see
+// SetMultiSymbolTables) and the avx2 gather ones (see SetGatherDecoders), checks that they all give the same output and prints the symbols/s of each
+int BenchEntropy(unsigned int megabytes);
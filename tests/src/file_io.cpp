@@ -0,0 +1,393 @@
+#include "file_io.h"
+
+#include <algorithm> // std::min, std::max
+#include <cstdlib> // std::abort
+#include <cstring> // std::memset
+#include <fstream>
+#include <thread>
+
+#if MC_TEST_IO_URING
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+ReadResult FileIO::WaitForRead() {
+    std::unique_lock lock(mMutex);
+    mReadFinished.wait(lock, [this] { return !mFinishedReads.empty(); });
+    ReadResult result = std::move(mFinishedReads.front());
+    mFinishedReads.pop_front();
+    return result;
+}
+
+size_t FileIO::FinishWrites() {
+    std::unique_lock lock(mMutex);
+    mWriteFinished.wait(lock, [this] { return mQueuedWrites == 0; });
+    size_t failed = mFailedWrites;
+    mFailedWrites = 0;
+    return failed;
+}
+
+void FileIO::CompleteRead(ReadResult result) {
+    {
+        std::lock_guard lock(mMutex);
+        mFinishedReads.push_back(std::move(result));
+    }
+    mReadFinished.notify_one();
+}
+
+void FileIO::WaitForWriteSlot() {
+    std::unique_lock lock(mMutex);
+    mWriteFinished.wait(lock, [this] { return mQueuedWrites < mMaxQueuedWrites; });
+    ++mQueuedWrites;
+}
+
+void FileIO::CompleteWrite(bool success) {
+    {
+        std::lock_guard lock(mMutex);
+        --mQueuedWrites;
+        if (!success)
+            ++mFailedWrites;
+    }
+    mWriteFinished.notify_all();
+}
+
+namespace {
+
+struct IORequest {
+    bool isWrite;
+    size_t index;
+    std::filesystem::path path;
+    std::vector<mc::u8> data;
+};
+
+class ThreadedFileIO : public FileIO {
+public:
+    explicit ThreadedFileIO(unsigned int threadCount) : FileIO(threadCount * 4) {
+        for (unsigned int i = 0; i < threadCount; ++i)
+            mThreads.emplace_back(&ThreadedFileIO::ThreadMain, this);
+    }
+
+    ~ThreadedFileIO() override {
+        {
+            std::lock_guard lock(mMutex);
+            mStop = true;
+        }
+        mRequestQueued.notify_all();
+        for (std::thread& thread : mThreads)
+            thread.join();
+    }
+
+    void StartRead(size_t index, const std::filesystem::path& path) override {
+        Queue({ false, index, path, {} });
+    }
+
+    void StartWrite(const std::filesystem::path& path, std::vector<mc::u8> data) override {
+        WaitForWriteSlot();
+        Queue({ true, 0, path, std::move(data) });
+    }
+
+    const char* GetName() const override {
+        return "threads";
+    }
+
+private:
+    void Queue(IORequest request) {
+        {
+            std::lock_guard lock(mMutex);
+            mRequests.push_back(std::move(request));
+        }
+        mRequestQueued.notify_one();
+    }
+
+    void ThreadMain() {
+        while (true) {
+            IORequest request;
+            {
+                std::unique_lock lock(mMutex);
+                mRequestQueued.wait(lock, [this] { return !mRequests.empty() || mStop; });
+                if (mRequests.empty())
+                    return;
+                request = std::move(mRequests.front());
+                mRequests.pop_front();
+            }
+
+            if (request.isWrite) {
+                std::ofstream file(request.path, std::ios::binary);
+                file.write(reinterpret_cast<const char*>(request.data.data()), request.data.size());
+                CompleteWrite(file.good());
+            } else {
+                ReadResult result{ request.index, false, {} };
+                std::ifstream file(request.path, std::ios::ate | std::ios::binary);
+                if (file.is_open()) {
+                    result.data.resize(file.tellg());
+                    file.seekg(0);
+                    file.read(reinterpret_cast<char*>(result.data.data()), result.data.size());
+                    result.success = file.good();
+                }
+                CompleteRead(std::move(result));
+            }
+        }
+    }
+
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mRequestQueued;
+    std::deque<IORequest> mRequests;
+    bool mStop = false;
+};
+
+#if MC_TEST_IO_URING
+
+// there's no liburing dependency so this talks to the kernel directly
+class UringFileIO : public FileIO {
+public:
+    explicit UringFileIO(unsigned int queueDepth) : FileIO(queueDepth), mQueueDepth(queueDepth) {}
+
+    ~UringFileIO() override {
+        if (mThread.joinable()) {
+            {
+                std::lock_guard lock(mMutex);
+                mStop = true;
+            }
+            mRequestQueued.notify_all();
+            mThread.join();
+        }
+        if (mSQEs != nullptr)
+            munmap(mSQEs, mSQEsSize);
+        if (mCQRing != nullptr && mCQRing != mSQRing)
+            munmap(mCQRing, mCQRingSize);
+        if (mSQRing != nullptr)
+            munmap(mSQRing, mSQRingSize);
+        if (mRingFd >= 0)
+            close(mRingFd);
+    }
+
+    bool Initialize() {
+        io_uring_params params{};
+        mRingFd = static_cast<int>(syscall(__NR_io_uring_setup, mQueueDepth, &params));
+        if (mRingFd < 0)
+            return false;
+
+        mSQRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        mCQRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap)
+            mSQRingSize = mCQRingSize = std::max(mSQRingSize, mCQRingSize);
+
+        mSQRing = reinterpret_cast<mc::u8*>(mmap(nullptr, mSQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQ_RING));
+        if (mSQRing == MAP_FAILED) {
+            mSQRing = nullptr;
+            return false;
+        }
+        if (singleMmap) {
+            mCQRing = mSQRing;
+        } else {
+            mCQRing = reinterpret_cast<mc::u8*>(mmap(nullptr, mCQRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_CQ_RING));
+            if (mCQRing == MAP_FAILED) {
+                mCQRing = nullptr;
+                return false;
+            }
+        }
+        mSQEsSize = params.sq_entries * sizeof(io_uring_sqe);
+        mSQEs = reinterpret_cast<io_uring_sqe*>(mmap(nullptr, mSQEsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mRingFd, IORING_OFF_SQES));
+        if (mSQEs == MAP_FAILED) {
+            mSQEs = nullptr;
+            return false;
+        }
+
+        mSQTail = reinterpret_cast<unsigned*>(mSQRing + params.sq_off.tail);
+        mSQMask = *reinterpret_cast<unsigned*>(mSQRing + params.sq_off.ring_mask);
+        mSQArray = reinterpret_cast<unsigned*>(mSQRing + params.sq_off.array);
+        mCQHead = reinterpret_cast<unsigned*>(mCQRing + params.cq_off.head);
+        mCQTail = reinterpret_cast<unsigned*>(mCQRing + params.cq_off.tail);
+        mCQMask = *reinterpret_cast<unsigned*>(mCQRing + params.cq_off.ring_mask);
+        mCQEs = reinterpret_cast<io_uring_cqe*>(mCQRing + params.cq_off.cqes);
+        mQueueDepth = std::min(mQueueDepth, params.sq_entries);
+
+        mThread = std::thread(&UringFileIO::ThreadMain, this);
+        return true;
+    }
+
+    void StartRead(size_t index, const std::filesystem::path& path) override {
+        Queue({ false, index, path, {} });
+    }
+
+    void StartWrite(const std::filesystem::path& path, std::vector<mc::u8> data) override {
+        WaitForWriteSlot();
+        Queue({ true, 0, path, std::move(data) });
+    }
+
+    const char* GetName() const override {
+        return "io_uring";
+    }
+
+private:
+    struct InFlight {
+        IORequest request;
+        int fd;
+        size_t offset;
+        iovec iov;
+    };
+
+    void Queue(IORequest request) {
+        {
+            std::lock_guard lock(mMutex);
+            mRequests.push_back(std::move(request));
+        }
+        mRequestQueued.notify_one();
+    }
+
+    void Finish(std::unique_ptr<InFlight> op, bool success) {
+        if (op->fd >= 0)
+            close(op->fd);
+        if (op->request.isWrite) {
+            op->request.data = {};
+            CompleteWrite(success);
+        } else {
+            CompleteRead({ op->request.index, success, success ? std::move(op->request.data) : std::vector<mc::u8>() });
+        }
+    }
+
+    // opening is done synchronously, only the data transfer goes through the ring
+    std::unique_ptr<InFlight> Open(IORequest request) {
+        auto op = std::make_unique<InFlight>();
+        op->request = std::move(request);
+        op->offset = 0;
+        if (op->request.isWrite) {
+            op->fd = open(op->request.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        } else {
+            op->fd = open(op->request.path.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (op->fd >= 0 && fstat(op->fd, &st) == 0)
+                op->request.data.resize(static_cast<size_t>(st.st_size));
+        }
+        return op;
+    }
+
+    void Push(InFlight* op) {
+        const unsigned tail = *mSQTail;
+        const unsigned index = tail & mSQMask;
+        io_uring_sqe& sqe = mSQEs[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        op->iov.iov_base = op->request.data.data() + op->offset;
+        op->iov.iov_len = op->request.data.size() - op->offset;
+        sqe.opcode = op->request.isWrite ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe.fd = op->fd;
+        sqe.off = op->offset;
+        sqe.addr = reinterpret_cast<mc::u64>(&op->iov);
+        sqe.len = 1;
+        sqe.user_data = reinterpret_cast<mc::u64>(op);
+        mSQArray[index] = index;
+        __atomic_store_n(mSQTail, tail + 1, __ATOMIC_RELEASE);
+        ++mToSubmit;
+        ++mInFlight;
+    }
+
+    void ThreadMain() {
+        while (true) {
+            std::deque<IORequest> requests;
+            {
+                std::unique_lock lock(mMutex);
+                if (mInFlight == 0)
+                    mRequestQueued.wait(lock, [this] { return !mRequests.empty() || mStop; });
+                if (mInFlight == 0 && mRequests.empty())
+                    return;
+                while (!mRequests.empty() && mInFlight + requests.size() < mQueueDepth) {
+                    requests.push_back(std::move(mRequests.front()));
+                    mRequests.pop_front();
+                }
+            }
+
+            for (IORequest& request : requests) {
+                std::unique_ptr<InFlight> op = Open(std::move(request));
+                if (op->fd < 0 || op->request.data.empty()) {
+                    const bool opened = op->fd >= 0;
+                    Finish(std::move(op), opened);
+                    continue;
+                }
+                Push(op.release());
+            }
+
+            if (mInFlight == 0)
+                continue;
+
+            // submits everything new and waits for at least one completion
+            const int submitted = static_cast<int>(syscall(__NR_io_uring_enter, mRingFd, mToSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // the ring is unusable at this point, nothing in flight will ever complete
+                std::abort();
+            }
+            if (submitted > 0)
+                mToSubmit -= submitted;
+
+            unsigned head = *mCQHead;
+            const unsigned tail = __atomic_load_n(mCQTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = mCQEs[head & mCQMask];
+                std::unique_ptr<InFlight> op(reinterpret_cast<InFlight*>(cqe.user_data));
+                const int res = cqe.res;
+                --mInFlight;
+                if (res == -EAGAIN || res == -EINTR) {
+                    Push(op.release());
+                } else if (res <= 0) {
+                    Finish(std::move(op), false);
+                } else {
+                    op->offset += static_cast<size_t>(res);
+                    if (op->offset < op->request.data.size())
+                        Push(op.release()); // short read/write, queue the rest
+                    else
+                        Finish(std::move(op), true);
+                }
+            }
+            __atomic_store_n(mCQHead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    unsigned int mQueueDepth;
+    int mRingFd = -1;
+    mc::u8* mSQRing = nullptr;
+    mc::u8* mCQRing = nullptr;
+    size_t mSQRingSize = 0;
+    size_t mCQRingSize = 0;
+    io_uring_sqe* mSQEs = nullptr;
+    size_t mSQEsSize = 0;
+    unsigned* mSQTail = nullptr;
+    unsigned mSQMask = 0;
+    unsigned* mSQArray = nullptr;
+    unsigned* mCQHead = nullptr;
+    unsigned* mCQTail = nullptr;
+    unsigned mCQMask = 0;
+    io_uring_cqe* mCQEs = nullptr;
+    unsigned mToSubmit = 0;
+    size_t mInFlight = 0; // only touched by the ring thread
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mRequestQueued;
+    std::deque<IORequest> mRequests;
+    bool mStop = false;
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<FileIO> CreateUringFileIO(unsigned int queueDepth [[maybe_unused]]) {
+#if MC_TEST_IO_URING
+    auto io = std::make_unique<UringFileIO>(std::max(queueDepth, 1u));
+    if (io->Initialize())
+        return io;
+#endif
+    return nullptr;
+}
+
+std::unique_ptr<FileIO> CreateThreadedFileIO(unsigned int threadCount) {
+    return std::make_unique<ThreadedFileIO>(std::max(threadCount, 1u));
+}
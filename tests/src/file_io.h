@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mc_MeshCodec.h"
+
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct ReadResult {
+    size_t index;
+    bool success;
+    std::vector<mc::u8> data;
+};
+
+// asynchronous whole-file reads and writes for the batch tools so decode threads never block on the disk
+// every function is thread safe
+class FileIO {
+public:
+    virtual ~FileIO() = default;
+
+    // the result comes back from WaitForRead, index is just passed through
+    virtual void StartRead(size_t index, const std::filesystem::path& path) = 0;
+    // the data is released once it's on disk, blocks while too many writes are already queued so memory use stays bounded
+    virtual void StartWrite(const std::filesystem::path& path, std::vector<mc::u8> data) = 0;
+
+    // blocks until a read finishes (the caller has to make sure one was started)
+    ReadResult WaitForRead();
+    // blocks until every write has finished, returns how many failed
+    size_t FinishWrites();
+
+    virtual const char* GetName() const = 0;
+
+protected:
+    explicit FileIO(size_t maxQueuedWrites) : mMaxQueuedWrites(maxQueuedWrites) {}
+
+    void CompleteRead(ReadResult result);
+    void WaitForWriteSlot();
+    void CompleteWrite(bool success);
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mReadFinished;
+    std::condition_variable mWriteFinished;
+    std::deque<ReadResult> mFinishedReads;
+    size_t mMaxQueuedWrites;
+    size_t mQueuedWrites = 0;
+    size_t mFailedWrites = 0;
+};
+
+// returns nullptr if io_uring isn't available (not linux, built without it, old kernel, blocked by seccomp, ...)
+std::unique_ptr<FileIO> CreateUringFileIO(unsigned int queueDepth);
+// plain blocking reads and writes on a few threads of their own
+std::unique_ptr<FileIO> CreateThreadedFileIO(unsigned int threadCount);
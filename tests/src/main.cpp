@@ -1,27 +1,25 @@
-#include "mc_MeshCodec.h"
+#include "mc_ArenaProvider.h"
+#include "mc_DecoderSession.h"
+#include "batch_pipeline.h"
+#include "bench.h"
+#include "mapped_file.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <span>
 #include <string>
+#include <thread>
 #include <vector>
 #include <filesystem>
 
 #define MAX_FILEPATH 0x1000
 
-const std::string ParseInput(int argc, char** argv, int index) {
-    static std::string null_string = "";
-
-    if (argc < 2 + index) {
-        return null_string;
-    }
-
-    size_t size = strnlen(argv[1 + index], MAX_FILEPATH);
-    std::string value{argv[1 + index], argv[1 + index] + size};
-    return value;
-}
-
 bool ReadFile(const std::string path, std::vector<mc::u8>& data) {
     std::ifstream file(path, std::ios::ate | std::ios::binary);
 
@@ -44,72 +42,405 @@ void WriteFile(const std::string path, const std::span<const mc::u8>& data) {
     file.close();
 }
 
-bool Decompress(const std::filesystem::path compressedPath, void* workMem, const std::filesystem::path outputPath) {
+bool Decompress(const std::filesystem::path compressedPath, mc::DecoderSession& session, const std::filesystem::path outputPath) {
     std::vector<mc::u8> data;
     if (!ReadFile(compressedPath.string(), data)) {
         std::cout << "Failed to read file: " << compressedPath.string() << "\n";
         return false;
     }
 
-    auto header = reinterpret_cast<const mc::ResMeshCodecPackageHeader*>(data.data());
-    size_t decompressedSize = header->GetDecompressedSize();
-    std::vector<mc::u8> outputBuffer(decompressedSize);
+    // only the headers are read here so we can size everything exactly before decompressing
+    const mc::DecodeRequirements req = mc::QueryRequirements(data.data(), data.size());
+    if (req.type == mc::FileType::Invalid)
+        return false;
+
+    if (!session.Reserve(req.workMemorySize))
+        return false;
+
+    std::vector<mc::u8> outputBuffer(req.decompressedSize);
 
-    if (mc::DecompressMC(outputBuffer.data(), decompressedSize, data.data(), data.size(), workMem, 0x10000000)) {
+    bool success;
+    switch (req.type) {
+        case mc::FileType::MeshCodecPackage:
+            success = session.Decode(outputBuffer.data(), outputBuffer.size(), data.data(), data.size());
+            break;
+        case mc::FileType::Chunk:
+            success = session.DecodeChunk(outputBuffer.data(), outputBuffer.size(), data.data(), data.size());
+            break;
+        case mc::FileType::Quad:
+            success = session.DecodeQuad(outputBuffer.data(), outputBuffer.size(), data.data(), data.size());
+            break;
+        default:
+            success = false;
+            break;
+    }
+
+    if (success) {
         std::cout << compressedPath.filename() << "\n";
         std::filesystem::create_directories(outputPath);
         WriteFile((outputPath / compressedPath.stem()).string(), outputBuffer);
-        return true;
     }
 
-    return false;
+    return success;
 }
 
-bool DecompressCave(const std::filesystem::path compressedPath, void* workMem, const std::filesystem::path outputPath) {
-    std::vector<mc::u8> data;
-    if (!ReadFile(compressedPath.string(), data)) {
-        std::cout << "Failed to read file: " << compressedPath.string() << "\n";
+static bool IsCompressedFile(const std::filesystem::path& path) {
+    return path.extension() == ".mc" || path.extension() == ".chunk";
+}
+
+static bool DecodeWithSession(mc::DecoderSession& session, mc::FileType type, void* dst, size_t dstSize, std::span<const mc::u8> src) {
+    switch (type) {
+        case mc::FileType::MeshCodecPackage:
+            return session.Decode(dst, dstSize, src.data(), src.size());
+        case mc::FileType::Chunk:
+            return session.DecodeChunk(dst, dstSize, src.data(), src.size());
+        case mc::FileType::Quad:
+            return session.DecodeQuad(dst, dstSize, src.data(), src.size());
+        default:
+            return false;
+    }
+}
+
+struct FileStats {
+    size_t inputSize = 0;
+    size_t outputSize = 0;
+    double seconds = 0.0;
+};
+
+// inputs are mapped read-only and outputs are mapped at their final size, each thread has its own session (and so its own work memory)
+bool DecompressMapped(const std::filesystem::path& compressedPath, mc::DecoderSession& session, const std::filesystem::path& outputPath, FileStats& stats) {
+    const auto start = std::chrono::steady_clock::now();
+
+    InputFile input;
+    if (!input.Open(compressedPath))
+        return false;
+
+    const mc::DecodeRequirements req = mc::QueryRequirements(input.GetData().data(), input.GetData().size());
+    if (req.type == mc::FileType::Invalid)
+        return false;
+
+    if (!session.Reserve(req.workMemorySize))
+        return false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(outputPath, ec);
+
+    OutputFile output;
+    if (!output.Create(outputPath / compressedPath.stem(), req.decompressedSize))
+        return false;
+
+    const bool success = DecodeWithSession(session, req.type, output.GetData(), output.GetSize(), input.GetData());
+    if (!output.Close(!success) || !success)
         return false;
+
+    stats.inputSize = input.GetData().size();
+    stats.outputSize = req.decompressedSize;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return true;
+}
+
+static double ToMB(size_t size) {
+    return static_cast<double>(size) / (1024.0 * 1024.0);
+}
+
+static std::vector<std::filesystem::path> CollectFiles(const std::filesystem::path& dirPath) {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(dirPath)) {
+        if (entry.is_regular_file() && IsCompressedFile(entry.path()))
+            paths.push_back(entry.path());
     }
+    return paths;
+}
 
-    auto header = reinterpret_cast<const mc::ResChunkHeader*>(data.data());
-    size_t decompressedSize = header->decompressedSize;
-    std::vector<mc::u8> outputBuffer(decompressedSize);
+int DecompressDirectoryParallel(const std::filesystem::path& dirPath, const std::filesystem::path& outputPath, unsigned int threadCount, const mc::DecodeOptions& options) {
+    const std::vector<std::filesystem::path> paths = CollectFiles(dirPath);
 
-    if (mc::DecompressChunk(outputBuffer.data(), decompressedSize, data.data(), data.size(), workMem, 0x10000000)) {
-        std::cout << compressedPath.filename() << "\n";
-        std::filesystem::create_directories(outputPath);
-        WriteFile((outputPath / compressedPath.stem()).string(), outputBuffer);
-        return true;
+    std::atomic<size_t> nextFile = 0;
+    std::atomic<size_t> failedFiles = 0;
+    std::atomic<size_t> totalInput = 0;
+    std::atomic<size_t> totalOutput = 0;
+    std::mutex printMutex;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&] {
+        mc::DecoderSession session;
+        session.SetOptions(options);
+        for (size_t index = nextFile++; index < paths.size(); index = nextFile++) {
+            const std::filesystem::path& path = paths[index];
+            FileStats stats;
+            const bool success = DecompressMapped(path, session, outputPath / std::filesystem::relative(path.parent_path(), dirPath), stats);
+
+            std::lock_guard lock(printMutex);
+            if (success) {
+                totalInput += stats.inputSize;
+                totalOutput += stats.outputSize;
+                std::cout << path.filename() << " " << ToMB(stats.outputSize) / stats.seconds << " MB/s\n";
+            } else {
+                ++failedFiles;
+                std::cout << "Failed to decompress " << path.string() << "\n";
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const size_t decodedFiles = paths.size() - failedFiles;
+    std::cout << "\n" << decodedFiles << " files (" << failedFiles << " failed) in " << seconds << " s on " << threadCount << " threads\n";
+    std::cout << "input: " << ToMB(totalInput) << " MB (" << ToMB(totalInput) / seconds << " MB/s)\n";
+    std::cout << "output: " << ToMB(totalOutput) << " MB (" << ToMB(totalOutput) / seconds << " MB/s)\n";
+    std::cout << decodedFiles / seconds << " files/s\n";
+
+    return failedFiles == 0 ? 0 : 1;
+}
+
+// reads and writes go through io (io_uring or a few i/o threads) so the decode threads never wait on the disk
+int DecompressDirectoryPipelined(const std::filesystem::path& dirPath, const std::filesystem::path& outputPath, unsigned int threadCount, const std::string& ioMode,
+                                 const mc::DecodeOptions& options) {
+    const std::vector<std::filesystem::path> paths = CollectFiles(dirPath);
+
+    std::unique_ptr<FileIO> io;
+    if (ioMode == "uring") {
+        io = CreateUringFileIO(64);
+        if (io == nullptr)
+            std::cout << "io_uring is unavailable, falling back to i/o threads\n";
+    }
+    if (io == nullptr)
+        io = CreateThreadedFileIO(4);
+
+    std::atomic<size_t> totalOutput = 0;
+    std::mutex printMutex;
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t failedFiles = DecompressPipelined(*io, paths, dirPath, outputPath, threadCount, threadCount * 4,
+                                                   [&](const std::filesystem::path& path, bool success, size_t outputSize) {
+        std::lock_guard lock(printMutex);
+        if (success) {
+            totalOutput += outputSize;
+            std::cout << path.filename() << "\n";
+        } else {
+            std::cout << "Failed to decompress " << path.string() << "\n";
+        }
+    }, options);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t decodedFiles = paths.size() - std::min(failedFiles, paths.size());
+    std::cout << "\n" << decodedFiles << " files (" << failedFiles << " failed) in " << seconds << " s on " << threadCount << " threads using " << io->GetName() << "\n";
+    std::cout << "output: " << ToMB(totalOutput) << " MB (" << ToMB(totalOutput) / seconds << " MB/s)\n";
+    std::cout << decodedFiles / seconds << " files/s\n";
+
+    return failedFiles == 0 ? 0 : 1;
+}
+
+// decodes everything without writing anything out and compares the work memory each file's header asks for with what it actually used
+int ReportMemory(const std::filesystem::path& dirPath) {
+    const std::vector<std::filesystem::path> paths = CollectFiles(dirPath);
+
+    // spilling instead of exiting so files that need more than their header says show up in the report too
+    mc::DecoderSession session;
+    session.SetOptions({ .overflowPolicy = mc::OverflowPolicy::Spill });
+
+    struct Sample {
+        size_t workMemorySize;
+        size_t used;
+    };
+    std::vector<Sample> samples;
+    size_t failedFiles = 0;
+    std::vector<mc::u8> outputBuffer;
+
+    for (const std::filesystem::path& path : paths) {
+        InputFile input;
+        if (!input.Open(path)) {
+            ++failedFiles;
+            continue;
+        }
+
+        const mc::DecodeRequirements req = mc::QueryRequirements(input.GetData().data(), input.GetData().size());
+        // quads and .bfres.mc files without meshes don't use any work memory
+        if (req.type == mc::FileType::Invalid || req.type == mc::FileType::Quad || req.workMemorySize == 0)
+            continue;
+
+        outputBuffer.resize(req.decompressedSize);
+        if (!session.Reserve(req.workMemorySize) || !DecodeWithSession(session, req.type, outputBuffer.data(), outputBuffer.size(), input.GetData())) {
+            std::cout << "Failed to decompress " << path.string() << "\n";
+            ++failedFiles;
+            continue;
+        }
+
+        const mc::DecodeResult& result = session.GetLastResult();
+        samples.push_back({ result.workMemorySize, result.peakWorkMemoryUsage + result.peakSpilledSize });
+    }
+
+    if (samples.empty()) {
+        std::cout << "no files with work memory found (" << failedFiles << " failed)\n";
+        return failedFiles == 0 ? 0 : 1;
+    }
+
+    // how much of what the header asked for was used, in 10% steps (the last one is for files that needed more)
+    constexpr size_t cBucketCount = 11;
+    size_t buckets[cBucketCount] = {};
+    size_t totalRequested = 0;
+    size_t totalUsed = 0;
+    for (const Sample& sample : samples) {
+        const size_t bucket = sample.used > sample.workMemorySize ? cBucketCount - 1 : std::min<size_t>(sample.used * 10 / sample.workMemorySize, cBucketCount - 2);
+        ++buckets[bucket];
+        totalRequested += sample.workMemorySize;
+        totalUsed += sample.used;
     }
 
-    return false;
+    const size_t largestBucket = *std::max_element(std::begin(buckets), std::end(buckets));
+    std::cout << "peak work memory use / header workMemSize over " << samples.size() << " files\n";
+    for (size_t i = 0; i < cBucketCount; ++i) {
+        const std::string label = i == cBucketCount - 1 ? ">100%" : std::to_string(i * 10) + "-" + std::to_string((i + 1) * 10) + "%";
+        std::cout << std::setw(9) << label << " " << std::string(buckets[i] * 50 / largestBucket, '#') << " " << buckets[i] << "\n";
+    }
+
+    std::vector<size_t> used;
+    std::vector<size_t> requested;
+    for (const Sample& sample : samples) {
+        used.push_back(sample.used);
+        requested.push_back(sample.workMemorySize);
+    }
+    std::sort(used.begin(), used.end());
+    std::sort(requested.begin(), requested.end());
+    auto percentile = [](const std::vector<size_t>& values, double p) {
+        return values[std::min(static_cast<size_t>(p * values.size()), values.size() - 1)];
+    };
+
+    // the peak use percentiles are what DecodeOptions::maxWorkMemorySize (with OverflowPolicy::Spill) or an arena size would be picked from
+    std::cout << "\n" << std::setw(9) << "" << std::setw(20) << "header workMemSize" << std::setw(16) << "peak use" << "\n";
+    std::cout << std::fixed << std::setprecision(3);
+    for (double p : { 0.5, 0.95, 0.99, 1.0 }) {
+        const std::string label = p < 1.0 ? "p" + std::to_string(static_cast<int>(p * 100)) : "max";
+        std::cout << std::setw(9) << label << std::setw(17) << ToMB(percentile(requested, p)) << " MB" << std::setw(13) << ToMB(percentile(used, p)) << " MB\n";
+    }
+    std::cout << std::setw(9) << "total" << std::setw(17) << ToMB(totalRequested) << " MB" << std::setw(13) << ToMB(totalUsed) << " MB ("
+              << 100.0 * totalUsed / totalRequested << "%)\n";
+    if (failedFiles != 0)
+        std::cout << failedFiles << " files failed\n";
+
+    return failedFiles == 0 ? 0 : 1;
 }
 
 int main(int argc, char** argv) {
 
     // temporarily repurposing this as a simple cli program bc I'm lazy
+    // usage: mc_test [-j threads] [--io uring|threads] [--huge-pages|--hugetlb] [--attributes mask] [--attribute-threads n] [--max-meshes n] <input dir> <output dir>
+    //        mc_test --report-memory <input dir>
+    //        mc_test --bench arena [rounds] <input dir>
+    //        mc_test [-j threads] --bench blocks <input dir>
+    //        mc_test --bench seek <input dir>
+    //        mc_test --bench tables <input dir>
+    //        mc_test --bench bits [megabytes]
+    //        mc_test --bench entropy [megabytes]
+
+    unsigned int threadCount = 0;
+    std::string ioMode;
+    std::string benchName;
+    bool reportMemory = false;
+    bool hugePages = false;
+    bool hugeTLB = false;
+    uint32_t attributeMask = mc::DecodeOptions::cAllAttributes;
+    uint32_t attributeThreads = 0;
+    uint32_t maxMeshes = 0;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i], argv[i] + strnlen(argv[i], MAX_FILEPATH)};
+        if (arg == "-j" && i + 1 < argc) {
+            threadCount = static_cast<unsigned int>(std::stoul(argv[++i]));
+            if (threadCount == 0)
+                threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        } else if (arg == "--io" && i + 1 < argc) {
+            ioMode = argv[++i];
+        } else if (arg == "--report-memory") {
+            reportMemory = true;
+        } else if (arg == "--huge-pages") {
+            hugePages = true;
+        } else if (arg == "--hugetlb") {
+            hugePages = true;
+            hugeTLB = true;
+        } else if (arg == "--attributes" && i + 1 < argc) {
+            attributeMask = static_cast<uint32_t>(std::stoul(argv[++i], nullptr, 0)); // e.g. 0x1 for positions only
+        } else if (arg == "--attribute-threads" && i + 1 < argc) {
+            attributeThreads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--max-meshes" && i + 1 < argc) {
+            maxMeshes = static_cast<uint32_t>(std::stoul(argv[++i])); // e.g. 1 for just the highest LOD
+        } else if (arg == "--bench" && i + 1 < argc) {
+            benchName = argv[++i];
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (reportMemory && positional.size() == 1)
+        return ReportMemory(positional[0]);
+
+    if (benchName == "arena" && !positional.empty())
+        return BenchArena(CollectFiles(positional.back()), positional.size() > 1 ? static_cast<unsigned int>(std::stoul(positional[0])) : 5);
+
+    if (benchName == "blocks" && positional.size() == 1)
+        return BenchBlocks(CollectFiles(positional[0]), threadCount);
 
-    // 0x12ac10 is needed for StackAllocator initialization in game
-    // you can get away with around 0x120000 here since ZSTD_DCtx is smaller than in game
-    // allocate at least as much specified in the header - this includes the amount needed for StackAllocator + any additional buffers used for decompression
-    // I'm just allocating an absurdly high amount here to be safe
-    void* workMem = malloc(0x10000000);
+    if (benchName == "seek" && positional.size() == 1)
+        return BenchSeek(CollectFiles(positional[0]));
 
-    const std::filesystem::path dirPath = ParseInput(argc, argv, 0);
-    const std::filesystem::path outputPath = ParseInput(argc, argv, 1);
+    if (benchName == "tables" && positional.size() == 1)
+        return BenchTables(CollectFiles(positional[0]));
+
+    if (benchName == "bits")
+        return BenchBitReaders(positional.empty() ? 64 : static_cast<unsigned int>(std::stoul(positional[0])));
+
+    if (benchName == "entropy")
+        return BenchEntropy(positional.empty() ? 16 : static_cast<unsigned int>(std::stoul(positional[0])));
+
+    if (positional.size() < 2) {
+        std::cout << "usage: mc_test [-j threads] [--io uring|threads] [--huge-pages|--hugetlb] [--attributes mask] [--attribute-threads n] [--max-meshes n] <input dir> <output dir>\n";
+        std::cout << "       mc_test --report-memory <input dir>\n";
+        std::cout << "       mc_test --bench arena [rounds] <input dir>\n";
+        std::cout << "       mc_test [-j threads] --bench blocks <input dir>\n";
+        std::cout << "       mc_test --bench seek <input dir>\n";
+        std::cout << "       mc_test --bench tables <input dir>\n";
+        std::cout << "       mc_test --bench bits [megabytes]\n";
+        std::cout << "       mc_test --bench entropy [megabytes]\n";
+        return 1;
+    }
+
+    const std::filesystem::path dirPath = positional[0];
+    const std::filesystem::path outputPath = positional[1];
+
+    // work memory backed by 2 MB pages, see mc_ArenaProvider.h
+    mc::HugePageArenaProvider hugePageProvider({ .useHugeTLB = hugeTLB, .prefault = true });
+    mc::DecodeOptions options;
+    if (hugePages)
+        options.arenaProvider = &hugePageProvider;
+    options.attributeMask = attributeMask;
+    options.attributeThreads = attributeThreads;
+    options.maxMeshes = maxMeshes;
+
+    if (!ioMode.empty())
+        return DecompressDirectoryPipelined(dirPath, outputPath, threadCount != 0 ? threadCount : std::max(std::thread::hardware_concurrency(), 1u), ioMode, options);
+
+    if (threadCount != 0)
+        return DecompressDirectoryParallel(dirPath, outputPath, threadCount, options);
+
+    // the session reuses the zstd context + codec buffers between files and only grows its work memory
+    // when a file's header asks for more than the largest one so far (instead of reserving 256 MB up front)
+    mc::DecoderSession session;
+    session.SetOptions(options);
 
     for (const auto& entry : std::filesystem::recursive_directory_iterator(dirPath)) {
-        if (entry.path().extension() == ".mc") {
-            if (!Decompress(entry.path().string(), workMem, outputPath / std::filesystem::relative(entry.path().parent_path(), dirPath)))
-                std::cout << "Failed to decompress " << entry.path().string() << "\n";
-        } else if (entry.path().extension() == ".chunk") {
-            if (!DecompressCave(entry.path().string(), workMem, outputPath / std::filesystem::relative(entry.path().parent_path(), dirPath)))
+        if (IsCompressedFile(entry.path())) {
+            if (!Decompress(entry.path().string(), session, outputPath / std::filesystem::relative(entry.path().parent_path(), dirPath)))
                 std::cout << "Failed to decompress " << entry.path().string() << "\n";
         }
     }
 
-    free(workMem);
-
     return 0;
-}
\ No newline at end of file
+}
@@ -1,4 +1,5 @@
 #include "mc_MeshCodec.h"
+#include "batch_pipeline.h"
 
 #include <cstring>
 #include <fstream>
@@ -39,58 +40,6 @@ struct AppState {
 
 AppState g_appState;
 
-bool ReadFile(const std::string& path, std::vector<mc::u8>& data) {
-    std::ifstream file(path, std::ios::ate | std::ios::binary);
-    if (!file.is_open())
-        return false;
-    
-    data.resize(file.tellg());
-    file.seekg(0);
-    file.read(reinterpret_cast<char*>(data.data()), data.size());
-    file.close();
-    return true;
-}
-
-void WriteFile(const std::string& path, const std::span<const mc::u8>& data) {
-    std::ofstream file(path, std::ios::binary);
-    file.write(reinterpret_cast<const char*>(data.data()), data.size());
-    file.close();
-}
-
-bool Decompress(const std::filesystem::path& compressedPath, void* workMem, const std::filesystem::path& outputPath) {
-    std::vector<mc::u8> data;
-    if (!ReadFile(compressedPath.string(), data))
-        return false;
-
-    auto header = reinterpret_cast<const mc::ResMeshCodecPackageHeader*>(data.data());
-    size_t decompressedSize = header->GetDecompressedSize();
-    std::vector<mc::u8> outputBuffer(decompressedSize);
-
-    if (mc::DecompressMC(outputBuffer.data(), decompressedSize, data.data(), data.size(), workMem, 0x10000000)) {
-        std::filesystem::create_directories(outputPath);
-        WriteFile((outputPath / compressedPath.stem()).string(), outputBuffer);
-        return true;
-    }
-    return false;
-}
-
-bool DecompressCave(const std::filesystem::path& compressedPath, void* workMem, const std::filesystem::path& outputPath) {
-    std::vector<mc::u8> data;
-    if (!ReadFile(compressedPath.string(), data))
-        return false;
-
-    auto header = reinterpret_cast<const mc::ResChunkHeader*>(data.data());
-    size_t decompressedSize = header->decompressedSize;
-    std::vector<mc::u8> outputBuffer(decompressedSize);
-
-    if (mc::DecompressChunk(outputBuffer.data(), decompressedSize, data.data(), data.size(), workMem, 0x10000000)) {
-        std::filesystem::create_directories(outputPath);
-        WriteFile((outputPath / compressedPath.stem()).string(), outputBuffer);
-        return true;
-    }
-    return false;
-}
-
 #ifdef _WIN32
 std::string BrowseForFolder(const std::string& title) {
     std::string result;
@@ -158,10 +107,12 @@ void ProcessFiles() {
         g_appState.totalFiles = 0;
     }
 
+    std::vector<std::filesystem::path> paths;
     try {
         std::filesystem::path dirPath(inputPathStr);
         for (const auto& entry : std::filesystem::recursive_directory_iterator(dirPath)) {
             if (entry.path().extension() == ".mc" || entry.path().extension() == ".chunk") {
+                paths.push_back(entry.path());
                 g_appState.totalFiles++;
             }
         }
@@ -179,44 +130,39 @@ void ProcessFiles() {
         return;
     }
 
-    void* workMem = malloc(0x10000000);
-
     try {
         std::filesystem::path dirPath(inputPathStr);
         std::filesystem::path outputBasePath(outputPathStr);
 
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(dirPath)) {
-            if (entry.path().extension() == ".mc") {
-                auto relativePath = std::filesystem::relative(entry.path().parent_path(), dirPath);
-                if (Decompress(entry.path(), workMem, outputBasePath / relativePath)) {
-                    g_appState.successCount++;
-                } else {
-                    g_appState.failCount++;
-                }
-                g_appState.processedFiles++;
-            } else if (entry.path().extension() == ".chunk") {
-                auto relativePath = std::filesystem::relative(entry.path().parent_path(), dirPath);
-                if (DecompressCave(entry.path(), workMem, outputBasePath / relativePath)) {
-                    g_appState.successCount++;
-                } else {
-                    g_appState.failCount++;
-                }
-                g_appState.processedFiles++;
-            }
+        // reads are kept ahead of the decode threads and writes happen behind them
+        const unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        std::unique_ptr<FileIO> io = CreateUringFileIO(64);
+        if (io == nullptr)
+            io = CreateThreadedFileIO(4);
 
-            if (entry.path().extension() == ".mc" || entry.path().extension() == ".chunk") {
-                std::lock_guard<std::mutex> lock(g_appState.statusMutex);
-                g_appState.progress = static_cast<float>(g_appState.processedFiles) / static_cast<float>(g_appState.totalFiles);
-                g_appState.statusText = "Processing: " + std::to_string(g_appState.processedFiles) + " / " + std::to_string(g_appState.totalFiles);
+        const size_t failed = DecompressPipelined(*io, paths, dirPath, outputBasePath, threadCount, threadCount * 4,
+                                                  [](const std::filesystem::path&, bool success, size_t) {
+            std::lock_guard<std::mutex> lock(g_appState.statusMutex);
+            if (success) {
+                g_appState.successCount++;
+            } else {
+                g_appState.failCount++;
             }
-        }
+            g_appState.processedFiles++;
+            g_appState.progress = static_cast<float>(g_appState.processedFiles) / static_cast<float>(g_appState.totalFiles);
+            g_appState.statusText = "Processing: " + std::to_string(g_appState.processedFiles) + " / " + std::to_string(g_appState.totalFiles);
+        });
+
+        // files that decoded but failed to write are only known once every write is done
+        std::lock_guard<std::mutex> lock(g_appState.statusMutex);
+        const int writeFailures = static_cast<int>(failed) - g_appState.failCount;
+        g_appState.successCount -= writeFailures;
+        g_appState.failCount += writeFailures;
     } catch (const std::exception& e) {
         std::lock_guard<std::mutex> lock(g_appState.statusMutex);
         g_appState.statusText = std::string("Error: ") + e.what();
     }
 
-    free(workMem);
-
     {
         std::lock_guard<std::mutex> lock(g_appState.statusMutex);
         g_appState.statusText = "Complete! Success: " + std::to_string(g_appState.successCount) + ", Failed: " + std::to_string(g_appState.failCount);
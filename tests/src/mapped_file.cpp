@@ -0,0 +1,134 @@
+#include "mapped_file.h"
+
+#include <fstream>
+
+#if MC_TEST_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool InputFile::Open(const std::filesystem::path& path) {
+    Close();
+
+#if MC_TEST_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    mSize = static_cast<size_t>(st.st_size);
+    if (mSize != 0) {
+        void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            mSize = 0;
+            return false;
+        }
+        // the whole file gets read front to back
+        madvise(data, mSize, MADV_SEQUENTIAL);
+        madvise(data, mSize, MADV_WILLNEED);
+        mData = reinterpret_cast<const mc::u8*>(data);
+        mMapped = true;
+    }
+    close(fd); // the mapping keeps the file alive
+
+    return true;
+#else
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    mBuffer.resize(file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(mBuffer.data()), mBuffer.size());
+
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+
+    return true;
+#endif
+}
+
+void InputFile::Close() {
+#if MC_TEST_HAS_MMAP
+    if (mMapped)
+        munmap(const_cast<mc::u8*>(mData), mSize);
+#endif
+    mMapped = false;
+    mData = nullptr;
+    mSize = 0;
+    mBuffer = {};
+}
+
+bool OutputFile::Create(const std::filesystem::path& path, size_t size) {
+    Close();
+
+    mPath = path;
+    mSize = size;
+
+#if MC_TEST_HAS_MMAP
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    // extending the file with ftruncate leaves it sparse, so nothing gets zero-filled by hand
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    if (size != 0) {
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        mData = reinterpret_cast<mc::u8*>(data);
+        mMapped = true;
+    }
+    close(fd);
+#else
+    mBuffer.resize(size);
+    mData = mBuffer.data();
+#endif
+
+    mOpen = true;
+    return true;
+}
+
+bool OutputFile::Close(bool discard) {
+    if (!mOpen)
+        return true;
+
+    bool success = true;
+#if MC_TEST_HAS_MMAP
+    if (mMapped)
+        munmap(mData, mSize);
+#else
+    if (!discard) {
+        std::ofstream file(mPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(mBuffer.data()), mBuffer.size());
+        success = file.good();
+    }
+    mBuffer = {};
+#endif
+
+    if (discard) {
+        std::error_code ec;
+        std::filesystem::remove(mPath, ec);
+    }
+
+    mOpen = false;
+    mMapped = false;
+    mData = nullptr;
+    mSize = 0;
+
+    return success;
+}
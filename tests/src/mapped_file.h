@@ -0,0 +1,67 @@
+#pragma once
+
+#include "mc_MeshCodec.h"
+
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MC_TEST_HAS_MMAP 1
+#else
+#define MC_TEST_HAS_MMAP 0
+#endif
+
+// read-only view of a whole file, memory mapped where possible (read into a buffer otherwise)
+class InputFile {
+public:
+    InputFile() = default;
+    ~InputFile() { Close(); }
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    bool Open(const std::filesystem::path& path);
+    void Close();
+
+    std::span<const mc::u8> GetData() const {
+        return { mData, mSize };
+    }
+
+private:
+    const mc::u8* mData = nullptr;
+    size_t mSize = 0;
+    bool mMapped = false;
+    std::vector<mc::u8> mBuffer;
+};
+
+// file that's created at its final size up front and written through a shared mapping, so there's no zero-filled staging buffer
+// (falls back to a buffer that gets written out on Close without mmap)
+class OutputFile {
+public:
+    OutputFile() = default;
+    ~OutputFile() { Close(); }
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool Create(const std::filesystem::path& path, size_t size);
+    // discard removes the file instead of keeping whatever was written so far
+    bool Close(bool discard = false);
+
+    mc::u8* GetData() {
+        return mData;
+    }
+
+    size_t GetSize() const {
+        return mSize;
+    }
+
+private:
+    std::filesystem::path mPath;
+    mc::u8* mData = nullptr;
+    size_t mSize = 0;
+    bool mOpen = false;
+    bool mMapped = false;
+    std::vector<mc::u8> mBuffer;
+};